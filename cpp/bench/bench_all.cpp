@@ -0,0 +1,289 @@
+#include "../include/nfa.h"
+#include "../include/dfa.h"
+#include "../include/pattern_set.h"
+#include "../include/shift_and.h"
+#include "../include/pike_vm.h"
+#include "../include/simd.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Builds (a|b)*a(a|b)(a|b)...(a|b) with n trailing groups; its DFA has about 2^(n+1) states.
+std::string blowupPattern(int n)
+{
+    std::string regex = "(a|b)*a";
+    for (int i = 0; i < n; ++i)
+        regex += "(a|b)";
+    return regex;
+}
+
+// OK Time regex -> NFA -> DFA for one pattern, best of `runs`
+void benchCompile(const std::string &label, const std::string &regex, int runs = 3)
+{
+    double best = 1e300;
+    size_t states = 0;
+    for (int r = 0; r < runs; ++r)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        NFA nfa = regexToNFA(regex);
+        DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        states = dfa.states.size();
+    }
+    std::cout << "  " << std::left << std::setw(24) << label
+              << std::right << std::setw(8) << states << " DFA states"
+              << std::setw(12) << std::fixed << std::setprecision(3) << best << " ms\n";
+}
+
+// OK Time minimizeDFA on the DFA of one pattern, best of `runs`
+void benchMinimize(const std::string &label, const std::string &regex, int runs = 3)
+{
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    double best = 1e300;
+    size_t states = 0;
+    for (int r = 0; r < runs; ++r)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        DFA min = minimizeDFA(dfa);
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        states = min.states.size();
+    }
+    std::cout << "  " << std::left << std::setw(24) << label
+              << std::right << std::setw(8) << dfa.states.size() << " -> " << states << " states"
+              << std::setw(12) << std::fixed << std::setprecision(3) << best << " ms\n";
+}
+
+// OK Time simulateDFA on a long input with the map-based and dense DFAs
+void benchSimulate(const std::string &regex, size_t length)
+{
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    DenseDFA dense = compileDFA(dfa);
+
+    std::string input;
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < length; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        input += (seed >> 16) & 1 ? 'a' : 'b';
+    }
+
+    auto run = [&](const std::string &label, auto simulate)
+    {
+        std::vector<int> trace;
+        trace.reserve(length + 1);
+        auto t0 = std::chrono::steady_clock::now();
+        bool accepted = simulate(trace);
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        std::cout << "  " << std::left << std::setw(24) << label
+                  << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+                  << length / ms / 1000.0 << " MB/s" << (accepted ? "  (accepted)" : "") << "\n";
+    };
+    run("map DFA", [&](std::vector<int> &trace)
+        { return simulateDFA(dfa, input, trace); });
+    run("dense DFA", [&](std::vector<int> &trace)
+        { return simulateDFA(dense, input, trace); });
+    run("dense DFA, compact trace", [&](std::vector<int> &)
+        { CompactTrace compact;
+          return simulateDFA(dense, input.data(), input.size(), compact); });
+    run("dense DFA, no trace", [&](std::vector<int> &)
+        { return matchDFA(dense, input); });
+}
+
+// OK Time build + match for the DFA, the Shift-And engine and the Pike VM;
+// the DFA is skipped past maxDFAGroups where it would take too long to build
+void benchEngines(int n, size_t length, int maxDFAGroups)
+{
+    const std::string regex = blowupPattern(n);
+    std::string input;
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < length; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        input += (seed >> 16) & 1 ? 'a' : 'b';
+    }
+
+    auto ms = [](auto a, auto b)
+    { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::cout << "  " << std::left << std::setw(10) << ("n = " + std::to_string(n)) << std::right << std::fixed << std::setprecision(1);
+
+    auto t0 = std::chrono::steady_clock::now();
+    ShiftAndMatcher matcher(regexToGlushkov(regex));
+    bool shiftAccepted = matcher.match(input);
+    auto t1 = std::chrono::steady_clock::now();
+    PikeVM vm(flattenNFA(regexToNFA(regex)));
+    bool pikeAccepted = vm.match(input);
+    auto t2 = std::chrono::steady_clock::now();
+
+    if (n <= maxDFAGroups)
+    {
+        DenseDFA dense = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))));
+        bool dfaAccepted = matchDFA(dense, input);
+        auto t3 = std::chrono::steady_clock::now();
+        std::cout << std::setw(10) << ms(t2, t3) << " ms DFA (" << std::setw(6) << dense.numStates << " states)"
+                  << (dfaAccepted == pikeAccepted ? "" : "  MISMATCH");
+    }
+    else
+    {
+        std::cout << std::setw(32) << "DFA skipped";
+    }
+    std::cout << std::setw(10) << ms(t0, t1) << " ms shift-and" << std::setw(10) << ms(t1, t2) << " ms pike ("
+              << vm.programSize() << " insts)" << (shiftAccepted == pikeAccepted ? "" : "  MISMATCH") << "\n";
+}
+
+// OK Time matching many patterns one DFA at a time against one pattern-set DFA
+void benchPatternSet(int patterns, size_t lines)
+{
+    uint32_t seed = 777;
+    auto next = [&]()
+    {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 16;
+    };
+    auto word = [&](size_t length)
+    {
+        std::string w;
+        for (size_t i = 0; i < length; ++i)
+            w += static_cast<char>('a' + next() % 4);
+        return w;
+    };
+
+    std::vector<std::string> regexes;
+    for (int i = 0; i < patterns; ++i)
+        regexes.push_back(word(3) + "(a|b)*" + word(2));
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < lines; ++i)
+        inputs.push_back(word(4 + next() % 12));
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<DenseDFA> separate;
+    for (const auto &regex : regexes)
+        separate.push_back(compileDFA(minimizeDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))))));
+    auto t1 = std::chrono::steady_clock::now();
+    PatternSet set = compilePatternSet(regexes);
+    auto t2 = std::chrono::steady_clock::now();
+
+    size_t separateHits = 0, setHits = 0;
+    for (const auto &input : inputs)
+        for (const auto &dfa : separate)
+            separateHits += matchDFA(dfa, input);
+    auto t3 = std::chrono::steady_clock::now();
+    for (const auto &input : inputs)
+        setHits += set.match(input).size();
+    auto t4 = std::chrono::steady_clock::now();
+
+    auto ms = [](auto a, auto b)
+    { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::cout << "  " << std::left << std::setw(24) << "separate DFAs" << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << ms(t0, t1) << " ms compile" << std::setw(10) << ms(t2, t3) << " ms match (" << separateHits << " hits)\n";
+    std::cout << "  " << std::left << std::setw(24) << "pattern set" << std::right
+              << std::setw(10) << ms(t1, t2) << " ms compile" << std::setw(10) << ms(t3, t4) << " ms match (" << setHits << " hits, "
+              << set.dfa.states.size() << " states)\n";
+}
+
+// OK Time verdict-only line classification: scalar matchDFA per line against
+// the 16-lane PSHUFB classifier (batch --simd-lanes), on the minimized DFA
+void benchLanes(const std::string &regex, size_t lines)
+{
+    DenseDFA dfa = compileDFA(minimizeDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex)))));
+    ShuffleDFA shuffle = compileShuffleDFA(dfa);
+
+    const std::string alphabet = "abxyz019@q. ";
+    std::string text;
+    uint32_t seed = 4242;
+    for (size_t l = 0; l < lines; ++l)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t length = 4 + (seed >> 16) % 24;
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            text += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        text += '\n';
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t scalarHits = 0;
+    const char *end = text.data() + text.size();
+    for (const char *p = text.data(); p < end;)
+    {
+        const char *newline = findNewline(p, end);
+        scalarHits += matchDFA(dfa, p, static_cast<size_t>(newline - p));
+        p = newline + 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t laneHits = 0;
+    if (shuffle.usable)
+    {
+        std::vector<uint8_t> verdicts;
+        classifyLines(shuffle, text.data(), text.size(), verdicts);
+        for (uint8_t v : verdicts)
+            laneHits += v;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    auto ms = [](auto a, auto b)
+    { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::cout << "  " << std::left << std::setw(24) << regex << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << ms(t0, t1) << " ms matchDFA";
+    if (shuffle.usable)
+        std::cout << std::setw(10) << ms(t1, t2) << " ms lanes" << (laneHits == scalarHits ? "" : "  MISMATCH");
+    else
+        std::cout << "  (" << dfa.numStates << " states, no lanes)";
+    std::cout << "\n";
+}
+
+int main()
+{
+    std::cout << "===== Subset construction: (a|b)*a(a|b){n} =====\n";
+    for (int n = 4; n <= 14; n += 2)
+        benchCompile("n = " + std::to_string(n), blowupPattern(n));
+
+    std::cout << "\n===== Subset construction: wide alternation =====\n";
+    std::string alt = "(a";
+    for (char c = 'b'; c <= 'z'; ++c)
+        alt += std::string("|") + c;
+    alt += ")";
+    std::string wide = alt + "*";
+    for (int i = 0; i < 8; ++i)
+        wide += alt;
+    benchCompile("(a|...|z)*(a|...|z){8}", wide);
+    std::string classes = "[a-z]*";
+    for (int i = 0; i < 8; ++i)
+        classes += "[a-z]";
+    benchCompile("[a-z]*[a-z]{8}", classes);
+    benchCompile(".*[^a-z]{6}", ".*[^a-z]{6}");
+    benchCompile("\\w+@\\w+\\.\\w+", "\\w+@\\w+\\.\\w+");
+    benchCompile("(?u).*[^\\x00-\\x7f]{4}", "(?u).*[^\\x00-\\x7f]{4}");
+    benchCompile("(?u)[alpha-omega]+ \\d{2}", "(?u)[\xce\xb1-\xcf\x89]+ \\d{2}");
+
+    std::cout << "\n===== Subset construction: counted repetition =====\n";
+    for (int n : {50, 200, 800})
+        benchCompile("(ab|c){10," + std::to_string(n) + "}", "(ab|c){10," + std::to_string(n) + "}");
+
+    std::cout << "\n===== Hopcroft minimization: (a|b)*a(a|b){n} =====\n";
+    for (int n = 4; n <= 16; n += 4)
+        benchMinimize("n = " + std::to_string(n), blowupPattern(n));
+
+    std::cout << "\n===== Simulation throughput: (a|b)*abb on 16 MB =====\n";
+    benchSimulate("(a|b)*abb", 16 << 20);
+
+    std::cout << "\n===== DFA vs Shift-And vs Pike VM (build + match 1 MB): (a|b)*a(a|b){n} =====\n";
+    for (int n = 2; n <= 26; n += 4)
+        benchEngines(n, 1 << 20, 14);
+
+    std::cout << "\n===== Pattern sets: 200 patterns x 100k lines =====\n";
+    benchPatternSet(200, 100000);
+
+    std::cout << "\n===== Verdict-only lines: matchDFA vs SIMD lanes, 2M lines =====\n";
+    for (const char *regex : {"(a|b)*abb", "[a-z]+[0-9]", "\\w+@\\w+", ".*x", "[^q]*a[^q]*"})
+        benchLanes(regex, 2000000);
+    return 0;
+}
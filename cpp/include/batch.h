@@ -0,0 +1,34 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstddef>
+#include "dfa.h"
+
+struct BatchOptions
+{
+    unsigned threads = 1;          // simulation workers
+    size_t chunkBytes = 4 << 20;   // input slice handed to one worker
+    bool traces = true;            // false: report only the verdict per line
+    std::string prefilter;         // literal every match contains; without traces, lines lacking it skip the DFA
+    bool simdLanes = false;        // without traces or prefilter, step 16 lines at once in SSSE3 lanes (see bench_all)
+};
+
+struct BatchStats
+{
+    size_t lines = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+    size_t prefilterHits = 0; // lines that contained the prefilter literal
+};
+
+// Streams `in` through a reader -> worker pool -> writer pipeline. The reader
+// slices the input into chunks that end on a line boundary, workers simulate
+// every line of a chunk against the shared DFA and format its result, and the
+// writer emits the formatted chunks to `out` in their original order. Without
+// traces, lines are screened for the prefilter literal first when one is set;
+// with simdLanes, DFAs of up to 16 states classify lines in SIMD lanes.
+BatchStats runBatch(const DenseDFA &dfa, std::istream &in, std::ostream &out, const BatchOptions &options);
+
+// Same pipeline over an in-memory buffer (e.g. a mapped file): chunks are
+// spans of `data` and lines are matched in place without being copied.
+BatchStats runBatch(const DenseDFA &dfa, const char *data, size_t size, std::ostream &out, const BatchOptions &options);
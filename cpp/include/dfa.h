@@ -3,25 +3,106 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
+#include "nfa.h"
 
 struct DFAState
 {
     int id;
-    std::set<int> nfaStates;         // The NFA states this DFA state represents
-    std::map<char, int> transitions; // input -> DFA state ID
+    std::set<int> nfaStates;                            // The NFA states this DFA state represents
+    std::vector<std::pair<ByteRange, int>> transitions; // sorted, non-overlapping ranges -> DFA state ID
     bool isAccept = false;
+    std::vector<int> accepts;                           // sorted ids of the patterns accepted here ({0} for a single regex)
+
+    int next(unsigned char b) const; // target on byte b by binary search, -1 if there is none
 };
 
 struct DFA
 {
     int startState;
     std::map<int, DFAState> states; // id -> DFAState
+    ByteClasses classes;            // byte classes the transitions were built over
+    size_t buildBytes = 0;          // peak bytes convertNFAtoDFA charged against max_bytes
+};
+
+// Compiled form of a DFA for simulation: row s of `table` holds the
+// transitions of state s by byte class, and input bytes are translated through
+// classOf. Missing transitions lead to the explicit dead state, whose row loops
+// on itself. Accept flags live in a parallel bit array.
+struct DenseDFA
+{
+    uint32_t numStates = 0; // including the dead state
+    uint32_t start = 0;
+    uint32_t dead = 0;
+    uint32_t numClasses = 0;
+    std::array<uint8_t, 256> classOf;
+    std::vector<uint32_t> table;     // numStates * numClasses
+    std::vector<uint64_t> acceptBits;
+    std::vector<int> stateIds;       // dense index -> DFA state id (for traces)
+    std::vector<std::vector<int>> acceptSets; // distinct pattern-id sets; acceptSets[0] is empty
+    std::vector<uint32_t> acceptSetOf;        // dense index -> index into acceptSets
+
+    bool isAccept(uint32_t s) const { return (acceptBits[s >> 6] >> (s & 63)) & 1; }
+};
+
+// Sparse trace of a dense simulation: the dense state after every `interval`
+// steps, so tracing n bytes costs O(n / interval) memory. Any range of the
+// full trace is rebuilt by replaying the input from the nearest checkpoint.
+struct CompactTrace
+{
+    uint32_t interval = 64;
+    size_t steps = 0;                  // bytes consumed before the end of input or the dead state
+    std::vector<uint32_t> checkpoints; // checkpoints[k] = dense state after k * interval steps
+};
+
+// Subset construction settings. With `unanchored` the start closure is merged
+// into every state, which yields the DFA of .*R: it accepts at each position
+// where some match of R ends. The limits bound the DFA being built (0 means
+// no limit); bytes are an estimate of its heap footprint.
+struct DFABuildOptions
+{
+    bool unanchored = false;
+    size_t maxStates = 0;
+    size_t maxBytes = 0;
+};
+
+// Thrown by convertNFAtoDFA as soon as a build limit is crossed.
+class DFABuildError : public std::runtime_error
+{
+public:
+    enum Limit
+    {
+        MaxStates,
+        MaxBytes
+    };
+
+    DFABuildError(Limit limit, size_t states, size_t bytes, const DFABuildOptions &options);
+
+    Limit limit;
+    size_t states; // DFA states built when the build was aborted
+    size_t bytes;  // estimated bytes at that point
+    DFABuildOptions options;
+
+    const char *limitName() const { return limit == MaxStates ? "max_states" : "max_bytes"; }
 };
 
-DFA convertNFAtoDFA(State *nfaStart, int nfaAcceptId);
+DFA convertNFAtoDFA(const FlatNFA &nfa, const DFABuildOptions &options = {});
+DFA convertNFAtoDFA(State *nfaStart, int nfaAcceptId); // flattens the NFA first
+size_t estimateDFABytes(const DFA &dfa);
 nlohmann::json exportDFAtoJson(const DFA &dfa);
 void printDFA(const DFA &dfa);
 bool isDeadState(const DFAState &state, const std::set<int> &acceptStates);
 bool simulateDFA(const DFA &dfa, const std::string &input, std::vector<int> &trace, bool verbose = false);
-DFA minimizeDFA(const DFA &dfa);
+DenseDFA compileDFA(const DFA &dfa);
+bool simulateDFA(const DenseDFA &dfa, const std::string &input, std::vector<int> &trace);
+bool simulateDFA(const DenseDFA &dfa, const char *input, size_t length, std::vector<int> &trace);
+bool simulateDFA(const DenseDFA &dfa, const char *input, size_t length, CompactTrace &trace);
+std::vector<int> replayTrace(const DenseDFA &dfa, const char *input, const CompactTrace &trace,
+                             size_t from, size_t to); // state ids of trace positions [from, to)
+bool matchDFA(const DenseDFA &dfa, const std::string &input); // accept/reject only, no trace
+bool matchDFA(const DenseDFA &dfa, const char *input, size_t length);
+const std::vector<int> &matchingPatterns(const DenseDFA &dfa, const char *input, size_t length); // pattern sets
+DFA minimizeDFA(const DFA &dfa); // keeps states with different accept sets apart
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include "nfa.h"
+#include "state_set.h"
+
+struct LazyDFAOptions
+{
+    size_t memoryBudget = 1 << 20; // bytes of cached DFA states before the cache is flushed
+    int maxCacheClears = 8;        // flushes tolerated before falling back to NFA simulation
+    size_t maxClosureBytes = 0;    // limit on the ε-closure table, 0 = none; past it the constructor throws DFABuildError
+};
+
+struct LazyDFAStats
+{
+    size_t statesBuilt = 0;
+    size_t cacheClears = 0;
+    size_t cacheBytes = 0;
+    bool fellBack = false; // last match finished on NFA simulation
+};
+
+// DFA that is built on demand while matching. DFA states are created only when
+// the input drives into them and live in a cache bounded by memoryBudget; once
+// the cache has been flushed maxCacheClears times the engine stops building
+// states and finishes on plain NFA simulation.
+class LazyDFA
+{
+public:
+    explicit LazyDFA(FlatNFA nfa, LazyDFAOptions options = {});
+
+    bool match(const std::string &input);
+    const LazyDFAStats &stats() const { return stats_; }
+
+private:
+    static constexpr int kUnknown = -1;
+
+    struct CachedState
+    {
+        StateSet nfaStates;
+        bool isAccept = false;
+        bool isDead = false;
+        std::vector<int> next; // byte class -> cached state, kUnknown if not built yet
+    };
+
+    int intern(StateSet &&set);
+    StateSet move(const StateSet &from, int cls) const;
+    void clearCache();
+    size_t stateBytes() const;
+
+    FlatNFA nfa;
+    EpsilonClosures closures;
+    ByteClasses classes;
+    std::vector<std::pair<int, int>> edgeClasses; // symbol edge -> class ids it takes, [first, last)
+    LazyDFAOptions options;
+    LazyDFAStats stats_;
+    std::vector<CachedState> cache;
+    std::unordered_map<StateSet, int, StateSetHash> index;
+    int startState = kUnknown;
+};
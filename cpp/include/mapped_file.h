@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file. Uses mmap where available and falls back to
+// reading the file into memory elsewhere; either way data() stays valid for
+// the lifetime of the object.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool ok() const { return valid; }
+    const char *data() const { return begin; }
+    size_t size() const { return length; }
+
+private:
+    const char *begin = nullptr;
+    size_t length = 0;
+    bool valid = false;
+    bool mapped = false;
+    std::string fallback;
+};
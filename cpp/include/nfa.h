@@ -1,21 +1,203 @@
 #pragma once
 #include <vector>
+#include <array>
 #include <string>
 #include <map>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
 #include <nlohmann/json.hpp>
+#include "state_set.h"
+#include "regex_ast.h"
+
+// Inclusive interval [lo, hi] of byte values labelling one transition.
+struct ByteRange
+{
+    unsigned char lo = 0;
+    unsigned char hi = 0;
+
+    bool contains(unsigned char b) const { return lo <= b && b <= hi; }
+    bool operator==(const ByteRange &other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const ByteRange &other) const { return !(*this == other); }
+};
 
 struct State
 {
     int id;
-    std::map<char, std::vector<State *>> transitions; // char = '\0' means ε
+    std::vector<State *> epsilon;
+    std::vector<std::pair<ByteRange, State *>> transitions; // sorted, non-overlapping ranges -> next state
+};
+
+// Owns every State of one NFA. States are carved out of fixed-size blocks in
+// creation order (id == index) and are all released together with the arena.
+class StateArena
+{
+public:
+    static constexpr size_t kBlockStates = 64;
+
+    State *allocate();
+    State *at(int id) const;
+    size_t size() const { return count; }
+    size_t bytesReserved() const; // state slots plus the edge vectors of every state
+
+private:
+    std::vector<std::unique_ptr<State[]>> blocks;
+    size_t count = 0;
 };
 
 struct NFA
 {
-    State *start;
-    State *accept;
+    State *start = nullptr;
+    State *accept = nullptr;
+    std::unique_ptr<StateArena> arena; // owns start, accept and everything in between
+
+    size_t stateCount() const { return arena ? arena->size() : 0; }
+    size_t arenaBytes() const { return arena ? arena->bytesReserved() : 0; }
+};
+
+// Frozen, index-based form of an NFA in CSR layout. The ε-edges of state s are
+// epsTargets[epsOffsets[s] .. epsOffsets[s + 1]), and its symbol edges are the
+// parallel symRanges/symTargets slices [symOffsets[s] .. symOffsets[s + 1]).
+struct FlatNFA
+{
+    uint32_t numStates = 0;
+    uint32_t start = 0;
+    uint32_t accept = 0;
+    std::vector<uint32_t> accepts; // pattern sets: accept state of each pattern id; empty means {accept}
+    std::vector<uint32_t> epsOffsets;
+    std::vector<uint32_t> epsTargets;
+    std::vector<uint32_t> symOffsets;
+    std::vector<ByteRange> symRanges;
+    std::vector<uint32_t> symTargets;
+};
+
+// ε-closure of every NFA state, computed once by condensing the ε-graph into
+// strongly connected components. States of one component share a closure,
+// kept as a sorted list of state ids: component c owns
+// states[offsets[c] .. offsets[c + 1]). Memory follows the total closure
+// size rather than components x numStates bits.
+struct EpsilonClosures
+{
+    std::vector<uint32_t> component; // state -> component index
+    std::vector<uint32_t> offsets{0};
+    std::vector<uint32_t> states;
+    bool truncated = false; // stopped early at the byte limit; the lists are incomplete
+
+    size_t components() const { return offsets.size() - 1; }
+    size_t bytes() const { return (component.size() + offsets.size() + states.size()) * sizeof(uint32_t); }
+
+    // Adds the closure of `state` to `set`.
+    void addTo(StateSet &set, uint32_t state) const
+    {
+        uint32_t c = component[state];
+        for (uint32_t i = offsets[c]; i < offsets[c + 1]; ++i)
+            set.insert(states[i]);
+    }
+    StateSet of(uint32_t state) const
+    {
+        StateSet set(component.size());
+        addTo(set, state);
+        return set;
+    }
+};
+
+// Partition of the 256 byte values into classes that no transition label
+// distinguishes. Automata are built over class ids and input is translated
+// through classOf at match time. The default is one class per byte.
+struct ByteClasses
+{
+    std::array<uint8_t, 256> classOf;
+    int count = 256;
+
+    ByteClasses()
+    {
+        for (int b = 0; b < 256; ++b)
+            classOf[b] = static_cast<uint8_t>(b);
+    }
+
+
+    std::vector<unsigned char> members(int cls) const
+    {
+        std::vector<unsigned char> bytes;
+        for (int b = 0; b < 256; ++b)
+            if (classOf[b] == cls)
+                bytes.push_back(static_cast<unsigned char>(b));
+        return bytes;
+    }
+
+    // The members of each class as maximal byte ranges, ascending.
+    std::vector<std::vector<ByteRange>> ranges() const
+    {
+        std::vector<std::vector<ByteRange>> result(count);
+        for (int b = 0; b < 256; ++b)
+        {
+            std::vector<ByteRange> &runs = result[classOf[b]];
+            if (!runs.empty() && runs.back().hi + 1 == b)
+                runs.back().hi = static_cast<unsigned char>(b);
+            else
+                runs.push_back({static_cast<unsigned char>(b), static_cast<unsigned char>(b)});
+        }
+        return result;
+    }
+};
+
+// Position (Glushkov) automaton: no ε-edges and one state per literal or
+// class occurrence in the regex. Position 0 is the initial state; an edge
+// into position p is taken on any byte of symbol[p].
+struct GlushkovNFA
+{
+    std::vector<ByteSet> symbol;               // position -> its bytes (unused for 0)
+    std::vector<std::vector<uint32_t>> follow; // position -> positions that may come next
+    std::vector<uint32_t> finals;              // accepting positions, 0 included if "" matches
+
+    size_t positions() const { return symbol.size() - 1; }
+};
+
+// Sizes of what regexToNFA and regexToGlushkov would build, computed from the
+// AST alone so oversized patterns can be rejected or routed before anything
+// is allocated. Counts saturate at UINT64_MAX.
+struct RegexSize
+{
+    uint64_t nfaStates = 0;      // Thompson states, exact
+    uint64_t positions = 0;      // Glushkov positions, exact
+    uint64_t dfaStatesBound = 0; // upper bound on subset-construction states: 2^positions + 2
+    uint64_t dfaBytesBound = 0;  // upper bound on the eager build: dfaStatesBound NFA-state subsets
+
+    // Per state: the arena state, its flat-copy offsets and at least three
+    // ε-closure entries (component, offset and the state itself).
+    static constexpr uint64_t kBytesPerState = sizeof(State) + 5 * sizeof(uint32_t);
+    uint64_t nfaBytes() const { return nfaStates > UINT64_MAX / kBytesPerState ? UINT64_MAX : nfaStates * kBytesPerState; }
 };
 
+// The string overloads parse the regex first and throw RegexParseError.
+NFA regexToNFA(const RegexAST &ast);
 NFA regexToNFA(const std::string &regex);
-void printNFA(State *start);
-nlohmann::json exportToJson(State *start);
+GlushkovNFA regexToGlushkov(const RegexAST &ast);
+GlushkovNFA regexToGlushkov(const std::string &regex);
+std::string canonicalRegex(const RegexAST &ast); // postfix form with explicit concatenation
+std::string canonicalRegex(const std::string &regex);
+std::string requiredLiteral(const RegexAST &ast); // longest literal found in every match, "" if none
+std::string requiredLiteral(const std::string &regex);
+RegexSize estimateRegexSize(const RegexAST &ast);
+FlatNFA flattenNFA(const NFA &nfa);
+FlatNFA flattenNFA(State *start, int acceptId); // walks the states reachable from start
+FlatNFA reverseNFA(const FlatNFA &nfa);          // every edge flipped, start and accept swapped
+FlatNFA unionNFAs(const std::vector<FlatNFA> &nfas); // new start with ε-edges to each; pattern i keeps its accept
+// Stops with `truncated` set once the table passes maxBytes (0 = no limit).
+EpsilonClosures computeEpsilonClosures(const FlatNFA &nfa, size_t maxBytes = 0);
+ByteClasses computeByteClasses(const FlatNFA &nfa);
+// Classes taken by each range, as runs [first, last) of class ids. Class ids
+// must be numbered in order of their smallest byte, as computeByteClasses
+// leaves them; a range takes every class whose smallest byte it contains. The
+// classes of the ranges from one state to one target are thereby exact, since
+// a class lies wholly inside or wholly outside their bytes.
+std::vector<std::pair<int, int>> classSpans(const ByteClasses &classes, const std::vector<ByteRange> &ranges);
+std::vector<ByteRange> byteRanges(const ByteSet &set); // maximal runs of the set, ascending
+// UTF-8 encodings of the scalar values of a codepoint set as byte-range
+// sequences, ascending and disjoint: a string encodes a member exactly when it
+// matches one sequence.
+std::vector<std::vector<ByteRange>> utf8Sequences(const CodepointSet &set);
+std::string byteLabel(char c); // the byte itself if it is visible ASCII, \xHH otherwise
+std::string rangeLabel(ByteRange range); // byteLabel(lo), or "lo-hi" for a wider range
+void printNFA(const NFA &nfa);
+nlohmann::json exportToJson(const NFA &nfa);
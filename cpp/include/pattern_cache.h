@@ -0,0 +1,71 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include "nfa.h"
+#include "dfa.h"
+
+// Every automaton derived from one regex. Immutable once built, so it can be
+// shared between threads.
+struct CompiledPattern
+{
+    std::string key; // canonical (postfix) form of the regex
+    NFA nfa;
+    FlatNFA flat;
+    DFA dfa;
+    DFA minDFA;
+    DenseDFA dense;
+    DenseDFA denseMin;
+    std::string literal; // requiredLiteral(), used as a prefilter
+    size_t nfaBytes = 0; // estimateRegexSize().nfaBytes(), checked before building
+    size_t dfaBytes = 0; // dfa.buildBytes; both are checked against max_bytes again on cache hits
+    size_t bytes = 0; // estimated memory footprint
+};
+
+// Throws DFABuildError when the DFA exceeds the limits in `options` (or the
+// estimated NFA alone exceeds maxBytes), and RegexParseError for a malformed
+// regex.
+std::shared_ptr<const CompiledPattern> compilePattern(const RegexAST &ast, const DFABuildOptions &options = {});
+std::shared_ptr<const CompiledPattern> compilePattern(const std::string &regex, const DFABuildOptions &options = {});
+
+// Limits for callers that set none: far above any practical pattern, low
+// enough that a pathological one such as (a{1000}){1000} fails fast.
+DFABuildOptions defaultBuildLimits();
+
+struct PatternCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Thread-safe LRU cache of compiled patterns keyed by canonical regex. Least
+// recently used patterns are evicted once the estimated footprint exceeds
+// maxBytes; callers holding a pattern keep it alive past eviction.
+class PatternCache
+{
+public:
+    explicit PatternCache(size_t maxBytes = 64 << 20) : maxBytes(maxBytes) {}
+
+    // A cached pattern whose DFA exceeds `limits` throws DFABuildError just like
+    // a fresh build would, so a request's limits hold on hits and misses alike.
+    std::shared_ptr<const CompiledPattern> get(const std::string &regex, const DFABuildOptions &limits = defaultBuildLimits());
+    PatternCacheStats stats() const;
+    void clear();
+
+private:
+    using Entry = std::shared_ptr<const CompiledPattern>;
+
+    size_t maxBytes;
+    mutable std::mutex mutex;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    PatternCacheStats counters;
+};
+
+PatternCache &globalPatternCache();
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "dfa.h"
+
+// Many regexes compiled into one minimized DFA. The Thompson NFAs are unioned
+// under a single start state and every DFA state carries the ids of the
+// patterns it accepts, so one pass over an input reports all of them.
+struct PatternSet
+{
+    std::vector<std::string> patterns; // pattern id -> regex
+    DFA dfa;                           // minimized
+    DenseDFA dense;
+
+    const std::vector<int> &match(const char *input, size_t length) const { return matchingPatterns(dense, input, length); }
+    const std::vector<int> &match(const std::string &input) const { return match(input.data(), input.size()); }
+};
+
+PatternSet compilePatternSet(const std::vector<std::string> &regexes);
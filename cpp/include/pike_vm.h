@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "nfa.h"
+
+// Instruction of a Pike VM program. Range consumes one byte in [lo, hi] and
+// continues at x; Split forks to x and y; Jump continues at x; Match accepts;
+// Fail kills the thread.
+struct PikeInst
+{
+    enum Op : uint8_t
+    {
+        Range,
+        Split,
+        Jump,
+        Match,
+        Fail
+    };
+    Op op = Fail;
+    unsigned char lo = 0;
+    unsigned char hi = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+};
+
+struct PikeProgram
+{
+    std::vector<PikeInst> code;
+    uint32_t start = 0;
+};
+
+// Lays the states of a flat NFA out as instructions; a state with several
+// outgoing edges becomes a chain of Splits.
+PikeProgram compilePikeProgram(const FlatNFA &nfa);
+
+// Lock-step NFA simulation: all threads advance over the input together and
+// live in sparse sets indexed by program counter, so a pc is never queued
+// twice per step. Runs in O(n * m) time and O(m) memory for a program of m
+// instructions and never builds a DFA state.
+class PikeVM
+{
+public:
+    explicit PikeVM(const FlatNFA &nfa);
+
+    bool match(const char *input, size_t length);
+    bool match(const std::string &input) { return match(input.data(), input.size()); }
+    size_t programSize() const { return program.code.size(); }
+
+private:
+    struct SparseSet
+    {
+        std::vector<uint32_t> dense, sparse;
+        uint32_t size = 0;
+
+        void reset(size_t capacity)
+        {
+            dense.resize(capacity);
+            sparse.resize(capacity);
+            size = 0;
+        }
+        bool contains(uint32_t pc) const { return sparse[pc] < size && dense[sparse[pc]] == pc; }
+        void insert(uint32_t pc)
+        {
+            sparse[pc] = size;
+            dense[size++] = pc;
+        }
+    };
+
+    void addThread(SparseSet &list, uint32_t pc);
+
+    PikeProgram program;
+    SparseSet current, next;
+    std::vector<uint32_t> stack;
+};
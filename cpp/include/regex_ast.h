@@ -0,0 +1,83 @@
+#pragma once
+#include <bitset>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+using ByteSet = std::bitset<256>; // bit b set <=> byte value b is in the set
+using CodepointSet = std::vector<std::pair<uint32_t, uint32_t>>; // sorted, disjoint [lo, hi] scalar values
+
+// One node of a parsed regex. Children are indices into RegexAST::nodes.
+struct RegexNode
+{
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr uint32_t kUnbounded = UINT32_MAX; // Repeat with no upper bound
+
+    enum Kind : uint8_t
+    {
+        Empty,     // matches only ""
+        Literal,   // the single byte `byte`
+        Class,     // any one byte of sets[set]; classes of one byte become Literal
+        Utf8Class, // the UTF-8 encoding of any one codepoint of codepointSets[set]
+        Concat,    // left followed by right
+        Alternate, // left or right
+        Star,      // zero or more repetitions of left
+        Plus,      // one or more repetitions of left
+        Question,  // left or ""
+        Repeat     // min to max repetitions of left; never {0,0}, {1,1}, or a bound * + ? express
+    };
+
+    Kind kind = Empty;
+    char byte = '\0';
+    uint32_t left = kNone;
+    uint32_t right = kNone;
+    uint32_t set = kNone; // Class: index into RegexAST::sets, Utf8Class: into codepointSets
+    uint32_t min = 0;     // Repeat bounds
+    uint32_t max = 0;
+    uint32_t begin = 0;   // source span [begin, end) in the pattern, parentheses included
+    uint32_t end = 0;
+};
+
+// Every node of one regex, stored in postorder: children come before their
+// parent and the root is last, so a single forward pass over `nodes` folds
+// the tree bottom-up without recursion.
+struct RegexAST
+{
+    std::vector<RegexNode> nodes;
+    std::vector<ByteSet> sets;               // byte sets of the Class nodes
+    std::vector<CodepointSet> codepointSets; // codepoint sets of the Utf8Class nodes
+
+    uint32_t root() const { return static_cast<uint32_t>(nodes.size() - 1); }
+    const RegexNode &operator[](uint32_t i) const { return nodes[i]; }
+};
+
+class RegexParseError : public std::runtime_error
+{
+public:
+    RegexParseError(const std::string &message, size_t position);
+
+    size_t position; // byte offset of the offending character in the pattern
+};
+
+// Recursive-descent parser for
+//   regex  := '(?u)'? alt
+//   alt    := concat ('|' concat)*
+//   concat := repeat*
+//   repeat := atom ('*' | '+' | '?' | '{' m '}' | '{' m ',' '}' | '{' m ',' n '}')*
+//   atom   := char | '.' | '\' escape | '[' '^'? item+ ']' | '(' alt ')'
+// Literals are printable ASCII other than operators or UTF-8 encoded
+// characters, which match their encoding. Escapes are \d \w \s and their
+// negations, \n \t \r \f \v \0, \xHH, \u{H..} or \uHHHH, and '\' before any
+// punctuation. Counts are at most 1000. An empty pattern or branch matches "".
+// By default '.', classes and \D \W \S match one byte and classes may only
+// name ASCII characters. With the (?u) prefix they match one codepoint in
+// UTF-8 and \xHH is U+00HH. Throws RegexParseError.
+RegexAST parseRegex(const std::string &regex);
+
+std::string utf8Encode(uint32_t codepoint); // 1 to 4 bytes
+
+// Node -> index of the first node of its subtree; the subtree of i is the
+// contiguous range [first[i], i].
+std::vector<uint32_t> subtreeFirst(const RegexAST &ast);
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "nfa.h"
+#include "dfa.h"
+
+struct Match
+{
+    size_t start = 0;
+    size_t end = 0; // one past the last matched byte
+};
+
+// Finds occurrences of a pattern inside a text, leftmost-longest. Three DFAs
+// come out of the regular construction pipeline:
+//   - unanchored, .*R, answers "does R occur" in one forward pass;
+//   - reverse, .*R over the reversed NFA, is run from the end of the text
+//     towards the front and accepts exactly where a match starts;
+//   - forward, R itself, extends a known start to its longest match.
+class Searcher
+{
+public:
+    explicit Searcher(const FlatNFA &nfa);
+
+    bool occurs(const char *data, size_t size) const;
+    bool find(const char *data, size_t size, Match &match) const;     // leftmost-longest match
+    std::vector<Match> findAll(const char *data, size_t size) const; // non-overlapping, left to right
+
+private:
+    std::vector<uint64_t> matchStarts(const char *data, size_t size) const; // bit i: a match starts at i
+    size_t longestFrom(const char *data, size_t size, size_t start) const;
+
+    DenseDFA forward;
+    DenseDFA unanchored;
+    DenseDFA reverse;
+};
@@ -0,0 +1,16 @@
+#pragma once
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include "dfa.h"
+
+// Long-running worker for the web backend. Reads one JSON request per line
+// from `in` and writes one JSON response per line to `out`:
+//   {"op": "simulate", "regex": R, "input": S, "minimized": false}
+//   {"op": "export", "regex": R, "minimized": false}   (writes output/*.json)
+//   {"op": "stats"}                                     (pattern cache counters)
+// Compiled patterns are served from the global pattern cache. simulate and
+// export take optional "max_states" / "max_bytes" overriding `defaults`. A DFA
+// over those limits is reported as a structured error, except that simulate
+// falls back to a lazy DFA unless the request sets "fallback": false.
+void runServeMode(std::istream &in, std::ostream &out, const DFABuildOptions &defaults = {});
+nlohmann::json handleServeRequest(const nlohmann::json &request, const DFABuildOptions &defaults = {});
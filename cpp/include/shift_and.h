@@ -0,0 +1,29 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "nfa.h"
+
+// Bit-parallel simulation of a Glushkov automaton: bit p of the state word is
+// set while position p is active, so one step costs a few table lookups no
+// matter how many positions are active. Needs no DFA construction and cannot
+// blow up, but only handles patterns with at most kMaxPositions symbols.
+class ShiftAndMatcher
+{
+public:
+    static constexpr size_t kMaxPositions = 63; // bit 0 is the initial state
+
+    static bool fits(const GlushkovNFA &nfa) { return nfa.positions() <= kMaxPositions; }
+
+    explicit ShiftAndMatcher(const GlushkovNFA &nfa);
+
+    bool match(const char *input, size_t length) const;
+    bool match(const std::string &input) const { return match(input.data(), input.size()); }
+
+private:
+    std::array<uint64_t, 256> symbolMask{};              // byte -> positions labelled with it
+    std::vector<std::array<uint64_t, 256>> followTables; // table k: bits [8k, 8k + 8) -> union of their follow sets
+    uint64_t finalMask = 0;
+};
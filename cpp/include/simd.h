@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "dfa.h"
+
+// First '\n' in [begin, end), or end if there is none. Dispatches at runtime
+// to an AVX2 (32-byte blocks) or SSE2 (16-byte blocks) scan on x86, and to a
+// scalar loop elsewhere.
+const char *findNewline(const char *begin, const char *end);
+const char *simdLevel(); // "avx2", "sse2" or "scalar"
+
+// First occurrence of `literal` in [begin, end), or end if there is none.
+// With AVX2, 32 candidate positions are screened at a time on the literal's
+// first and last byte.
+const char *findLiteral(const char *begin, const char *end, const std::string &literal);
+
+// A DFA of at most 16 states (including the dead state) laid out for PSHUFB:
+// rows[c * 16 + s] is the successor of state s on byte class c, so one shuffle
+// steps 16 lanes at once.
+struct ShuffleDFA
+{
+    bool usable = false; // false when the DFA has more than 16 states
+    uint8_t start = 0;
+    uint8_t dead = 0;
+    uint32_t numClasses = 0;
+    uint16_t acceptMask = 0; // bit s set when state s accepts
+    std::array<uint8_t, 256> classOf;
+    std::vector<uint8_t> rows; // numClasses * 16
+};
+
+ShuffleDFA compileShuffleDFA(const DenseDFA &dfa);
+
+// Splits [data, data + size) at '\n' and appends one verdict (1 = accepted)
+// per line. Lines run 16 at a time in SSSE3 lanes when the CPU supports it.
+void classifyLines(const ShuffleDFA &dfa, const char *data, size_t size, std::vector<uint8_t> &verdicts);
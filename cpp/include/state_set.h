@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Dense bitset over NFA state indices; the identity of a DFA state during
+// subset construction.
+struct StateSet
+{
+    std::vector<uint64_t> words;
+
+    StateSet() = default;
+    explicit StateSet(size_t numStates) : words((numStates + 63) / 64, 0) {}
+
+    void insert(uint32_t s) { words[s >> 6] |= uint64_t(1) << (s & 63); }
+    bool contains(uint32_t s) const { return (words[s >> 6] >> (s & 63)) & 1; }
+
+    void unite(const StateSet &other)
+    {
+        for (size_t i = 0; i < words.size(); ++i)
+            words[i] |= other.words[i];
+    }
+
+    bool empty() const
+    {
+        for (uint64_t w : words)
+            if (w)
+                return false;
+        return true;
+    }
+
+    void clear()
+    {
+        for (uint64_t &w : words)
+            w = 0;
+    }
+
+    // Calls f(id) for every member in increasing order.
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            for (uint64_t w = words[i]; w; w &= w - 1)
+                f(static_cast<uint32_t>(i * 64 + __builtin_ctzll(w)));
+        }
+    }
+
+    bool operator==(const StateSet &other) const { return words == other.words; }
+};
+
+struct StateSetHash
+{
+    size_t operator()(const StateSet &set) const
+    {
+        uint64_t h = set.words.size();
+        for (uint64_t w : set.words)
+        {
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+        }
+        return static_cast<size_t>(h);
+    }
+};
@@ -2,8 +2,13 @@ from fastapi import FastAPI, HTTPException
 from fastapi.middleware.cors import CORSMiddleware
 from fastapi.responses import FileResponse
 from fastapi.staticfiles import StaticFiles
-from pydantic import BaseModel
+from pydantic import BaseModel, Field
+from typing import Optional
+from starlette.concurrency import run_in_threadpool
 import subprocess
+import threading
+import json
+import sys
 import os
 
 app = FastAPI()
@@ -27,12 +32,83 @@ OUTPUT_DIR = os.path.join(ROOT_DIR, "output")
 os.makedirs(VISUAL_DIR, exist_ok=True)
 os.makedirs(OUTPUT_DIR, exist_ok=True)
 
+# === DFA build limits: worker defaults, and the most a request may ask for ===
+MAX_STATES = 10_000
+MAX_BYTES = 64 << 20
+
+class LimitError(RuntimeError):
+    """The DFA for a request exceeded max_states or max_bytes."""
+
+    def __init__(self, response: dict):
+        super().__init__(response["error"])
+        self.detail = {k: response[k] for k in ("error", "limit", "states", "bytes", "max_states", "max_bytes")}
+
+class RegexError(RuntimeError):
+    """The regex of a request does not parse; `position` is the offending byte."""
+
+    def __init__(self, response: dict):
+        super().__init__(response["error"])
+        self.detail = {k: response[k] for k in ("error", "position")}
+
+# === Persistent C++ worker (main --serve) ===
+class Worker:
+    """Keeps one `main --serve` process alive and exchanges JSON lines with it."""
+
+    def __init__(self):
+        self.proc = None
+        self.lock = threading.Lock()
+        self.next_id = 0
+
+    def _ensure_running(self):
+        if self.proc is None or self.proc.poll() is not None:
+            self.proc = subprocess.Popen(
+                [BUILD_BIN, "--serve", "--max-states", str(MAX_STATES), "--max-bytes", str(MAX_BYTES)],
+                stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                text=True, bufsize=1, cwd=ROOT_DIR
+            )
+
+    def request(self, payload: dict) -> dict:
+        with self.lock:
+            self._ensure_running()
+            self.next_id += 1
+            payload = {**payload, "id": self.next_id}
+            try:
+                self.proc.stdin.write(json.dumps(payload) + "\n")
+                self.proc.stdin.flush()
+                line = self.proc.stdout.readline()
+            except (BrokenPipeError, OSError):
+                line = ""
+            if not line:
+                self.proc = None  # crashed; restarted on the next request
+                raise RuntimeError("worker exited while handling the request")
+            response = json.loads(line)
+        if response.get("status") != "ok":
+            if "limit" in response:
+                raise LimitError(response)
+            if "position" in response:
+                raise RegexError(response)
+            raise RuntimeError(response.get("error", "worker error"))
+        return response
+
+worker = Worker()
+
+def render(script: str):
+    subprocess.run([sys.executable, os.path.join("visualize", script)],
+                   check=True, capture_output=True, text=True, cwd=ROOT_DIR)
+
 # === Request models ===
-class GenerateRequest(BaseModel):
+class BuildLimits(BaseModel):
+    max_states: Optional[int] = Field(None, ge=1, le=MAX_STATES)
+    max_bytes: Optional[int] = Field(None, ge=1, le=MAX_BYTES)
+
+    def limits(self) -> dict:
+        return {k: v for k, v in (("max_states", self.max_states), ("max_bytes", self.max_bytes)) if v is not None}
+
+class GenerateRequest(BuildLimits):
     regex: str
     minimized: bool = False
 
-class SimulateRequest(BaseModel):
+class SimulateRequest(BuildLimits):
     regex: str
     input: str
 
@@ -40,16 +116,18 @@ class SimulateRequest(BaseModel):
 @app.post("/generate")
 async def generate(req: GenerateRequest):
     try:
-        subprocess.run(
-            [BUILD_BIN, "--visualize", req.regex],
-            check=True, capture_output=True, text=True, cwd=ROOT_DIR
-        )
+        await run_in_threadpool(worker.request, {"op": "export", "regex": req.regex, "minimized": req.minimized, **req.limits()})
+        await run_in_threadpool(render, "visualize_nfa.py")
+        await run_in_threadpool(render, "visualize_dfa.py")
         if req.minimized:
-            subprocess.run(
-                [BUILD_BIN, "--visualize-min", req.regex],
-                check=True, capture_output=True, text=True, cwd=ROOT_DIR
-            )
+            await run_in_threadpool(render, "visualize_min_dfa.py")
         return {"status": "ok", "message": "Visuals generated"}
+    except LimitError as e:
+        raise HTTPException(status_code=422, detail=e.detail)
+    except RegexError as e:
+        raise HTTPException(status_code=400, detail=e.detail)
+    except RuntimeError as e:
+        raise HTTPException(status_code=500, detail=str(e))
     except subprocess.CalledProcessError as e:
         raise HTTPException(status_code=500, detail=e.stderr)
 
@@ -57,13 +135,21 @@ async def generate(req: GenerateRequest):
 @app.post("/simulate")
 async def simulate(req: SimulateRequest):
     try:
-        result = subprocess.run(
-            [BUILD_BIN, "--simulate", req.regex, req.input, "--trace"],
-            check=True, capture_output=True, text=True, cwd=ROOT_DIR
-        )
-        return {"status": "ok", "trace": result.stdout}
-    except subprocess.CalledProcessError as e:
-        raise HTTPException(status_code=500, detail=e.stderr)
+        result = await run_in_threadpool(worker.request, {"op": "simulate", "regex": req.regex, "input": req.input, **req.limits()})
+    except LimitError as e:
+        raise HTTPException(status_code=422, detail=e.detail)
+    except RegexError as e:
+        raise HTTPException(status_code=400, detail=e.detail)
+    except RuntimeError as e:
+        raise HTTPException(status_code=500, detail=str(e))
+    verdict = "[OK] Accepted" if result["accepted"] else "[X] Rejected"
+    if "trace" in result:
+        trace = "Trace: " + " -> ".join(str(s) for s in result["trace"])
+    else:
+        # DFA limits were hit and the worker matched with the lazy engine instead.
+        trace = f"Trace: unavailable ({result['fallback']['error']}; matched with the {result['engine']} engine)"
+    return {"status": "ok", "trace": f"{trace}\nResult: {verdict}\n", "accepted": result["accepted"],
+            "engine": result["engine"]}
 
 # === GET /visuals/nfa|dfa|min_dfa ===
 @app.get("/visuals/{type}")
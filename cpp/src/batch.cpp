@@ -0,0 +1,258 @@
+#include "batch.h"
+#include "simd.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // A slice of the input: either a span of a mapped file or, for streams, a
+    // buffer the chunk owns.
+    struct Chunk
+    {
+        size_t seq = 0;
+        const char *data = nullptr;
+        size_t size = 0;
+        std::string owned;
+
+        const char *begin() const { return owned.empty() ? data : owned.data(); }
+        size_t length() const { return owned.empty() ? size : owned.size(); }
+    };
+
+    void formatChunk(const DenseDFA &dfa, const char *data, size_t size, std::string &out, size_t &lines)
+    {
+        std::vector<int> trace;
+        const char *end = data + size;
+        while (data < end)
+        {
+            const char *lineEnd = findNewline(data, end);
+            size_t length = static_cast<size_t>(lineEnd - data);
+
+            trace.clear();
+            bool accepted = simulateDFA(dfa, data, length, trace);
+
+            out += "Input: \"";
+            out.append(data, length);
+            out += "\" => ";
+            for (size_t i = 0; i < trace.size(); ++i)
+            {
+                out += std::to_string(trace[i]);
+                if (i + 1 < trace.size())
+                    out += " -> ";
+            }
+            out += accepted ? " => [OK] Accepted\n" : " => [X] Rejected\n";
+            lines++;
+            data = lineEnd + 1;
+        }
+    }
+
+    // Verdict-only formatting. With a prefilter literal only the lines that
+    // contain it reach the DFA; otherwise the SIMD lanes are used when they
+    // were asked for and the DFA is small enough.
+    void classifyChunk(const DenseDFA &dfa, const ShuffleDFA &shuffle, const std::string &literal,
+                       const char *data, size_t size, std::string &out, size_t &lines, size_t &hits)
+    {
+        std::vector<uint8_t> verdicts;
+        const bool lanes = shuffle.usable && literal.empty();
+        if (lanes)
+            classifyLines(shuffle, data, size, verdicts);
+
+        const char *end = data + size;
+        const char *nextHit = literal.empty() ? nullptr : findLiteral(data, end, literal);
+        for (size_t l = 0; data < end; ++l)
+        {
+            const char *lineEnd = findNewline(data, end);
+            size_t length = static_cast<size_t>(lineEnd - data);
+            bool accepted = false;
+            if (lanes)
+            {
+                accepted = verdicts[l];
+            }
+            else if (literal.empty())
+            {
+                accepted = matchDFA(dfa, data, length);
+            }
+            else if (nextHit < lineEnd)
+            {
+                // runPipeline cut the literal at its first '\n', so a hit that
+                // starts on this line ends on it.
+                hits++;
+                accepted = matchDFA(dfa, data, length);
+                nextHit = findLiteral(std::min(lineEnd + 1, end), end, literal);
+            }
+
+            out += "Input: \"";
+            out.append(data, length);
+            out += accepted ? "\" => [OK] Accepted\n" : "\" => [X] Rejected\n";
+            lines++;
+            data = lineEnd + 1;
+        }
+    }
+
+    // Runs the worker pool and ordered writer over the chunks produced by
+    // nextChunk, which returns false once the input is exhausted.
+    BatchStats runPipeline(const DenseDFA &dfa, std::ostream &out, const BatchOptions &options,
+                           const std::function<bool(Chunk &)> &nextChunk)
+    {
+        const unsigned threads = options.threads ? options.threads : 1;
+        const size_t maxInFlight = 2 * threads + 2;
+        const ShuffleDFA shuffle = options.traces || !options.simdLanes ? ShuffleDFA() : compileShuffleDFA(dfa);
+        // Lines are matched one at a time, so only the literal's part before
+        // its first '\n' can be required of a line.
+        const std::string prefilter = options.prefilter.substr(0, options.prefilter.find('\n'));
+        auto t0 = std::chrono::steady_clock::now();
+
+        std::mutex mutex;
+        std::condition_variable workReady, resultReady, slotFree;
+        std::deque<Chunk> work;
+        std::map<size_t, std::string> results;
+        size_t inFlight = 0;
+        bool inputDone = false;
+        size_t totalChunks = 0;
+        BatchStats stats;
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]
+                                 {
+                for (;;)
+                {
+                    Chunk chunk;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        workReady.wait(lock, [&] { return !work.empty() || inputDone; });
+                        if (work.empty())
+                            return;
+                        chunk = std::move(work.front());
+                        work.pop_front();
+                    }
+                    std::string formatted;
+                    size_t lines = 0, hits = 0;
+                    if (options.traces)
+                        formatChunk(dfa, chunk.begin(), chunk.length(), formatted, lines);
+                    else
+                        classifyChunk(dfa, shuffle, prefilter, chunk.begin(), chunk.length(), formatted, lines, hits);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stats.lines += lines;
+                        stats.prefilterHits += hits;
+                        results.emplace(chunk.seq, std::move(formatted));
+                    }
+                    resultReady.notify_one();
+                } });
+        }
+
+        std::thread writer([&]
+                           {
+            for (size_t next = 0;; ++next)
+            {
+                std::string formatted;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    resultReady.wait(lock, [&] { return results.count(next) || (inputDone && next == totalChunks); });
+                    if (!results.count(next))
+                        return;
+                    formatted = std::move(results[next]);
+                    results.erase(next);
+                    inFlight--;
+                }
+                slotFree.notify_one();
+                out.write(formatted.data(), formatted.size());
+            } });
+
+        for (;;)
+        {
+            Chunk chunk;
+            if (!nextChunk(chunk))
+                break;
+            stats.bytes += chunk.length();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            slotFree.wait(lock, [&] { return inFlight < maxInFlight; });
+            chunk.seq = totalChunks++;
+            work.push_back(std::move(chunk));
+            inFlight++;
+            lock.unlock();
+            workReady.notify_one();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inputDone = true;
+        }
+        workReady.notify_all();
+        resultReady.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+        resultReady.notify_all();
+        writer.join();
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return stats;
+    }
+}
+
+BatchStats runBatch(const DenseDFA &dfa, std::istream &in, std::ostream &out, const BatchOptions &options)
+{
+    // Fill chunks up to chunkBytes and carry any partial last line over.
+    std::string carry;
+    std::vector<char> buffer(options.chunkBytes);
+    bool eof = false;
+    return runPipeline(dfa, out, options, [&](Chunk &chunk)
+                       {
+        while (!eof)
+        {
+            in.read(buffer.data(), buffer.size());
+            size_t got = static_cast<size_t>(in.gcount());
+            eof = got < buffer.size();
+
+            std::string data = std::move(carry);
+            carry.clear();
+            data.append(buffer.data(), got);
+            if (!eof)
+            {
+                size_t lastNewline = data.rfind('\n');
+                if (lastNewline == std::string::npos)
+                {
+                    carry = std::move(data); // a single line longer than a chunk
+                    continue;
+                }
+                carry = data.substr(lastNewline + 1);
+                data.resize(lastNewline + 1);
+            }
+            if (data.empty())
+                return false;
+            chunk.owned = std::move(data);
+            return true;
+        }
+        return false; });
+}
+
+BatchStats runBatch(const DenseDFA &dfa, const char *data, size_t size, std::ostream &out, const BatchOptions &options)
+{
+    // Slices point straight into the caller's buffer; each one is extended to
+    // the next newline so no line is split.
+    size_t pos = 0;
+    return runPipeline(dfa, out, options, [&](Chunk &chunk)
+                       {
+        if (pos >= size)
+            return false;
+        size_t end = std::min(size, pos + options.chunkBytes);
+        if (end < size)
+        {
+            end = static_cast<size_t>(findNewline(data + end, data + size) - data);
+            end = std::min(size, end + 1);
+        }
+        chunk.data = data + pos;
+        chunk.size = end - pos;
+        pos = end;
+        return true; });
+}
@@ -1,127 +1,193 @@
 #include "nfa.h"
 #include "dfa.h"
+#include "state_set.h"
+#include <algorithm>
 #include <queue>
 #include <set>
 #include <map>
 #include <iostream>
+#include <unordered_map>
 
 using namespace std;
 
-// DFA conversion from NFA
-DFA convertNFAtoDFA(State *start, int nfaAcceptId)
+namespace
 {
-    DFA dfa;
-    map<set<State *>, int> stateMap;
-    map<int, set<State *>> reverseMap; // Track DFA state ID -> NFA state set
-    int idCounter = 0;
-
-    // Compute ε-closure of the start state
-    set<State *> startClosure = {start};
-    queue<State *> q;
-    set<int> visited;
-    q.push(start);
-    visited.insert(start->id);
-
-    while (!q.empty())
+    // Heap cost of one tree node of the std::map / std::set members.
+    const size_t kNodeOverhead = 4 * sizeof(void *);
+
+    std::string describeLimit(DFABuildError::Limit limit, size_t states, size_t bytes, const DFABuildOptions &options)
     {
-        State *curr = q.front();
-        q.pop();
-        for (State *epsNext : curr->transitions['\0'])
+        if (limit == DFABuildError::MaxStates)
+            return "DFA state limit exceeded: " + std::to_string(states) + " states built, max_states is " +
+                   std::to_string(options.maxStates);
+        if (states == 0)
+            return "pattern too large: its NFA and ε-closures need about " + std::to_string(bytes) + " bytes, max_bytes is " +
+                   std::to_string(options.maxBytes);
+        return "DFA memory limit exceeded: about " + std::to_string(bytes) + " bytes built, max_bytes is " +
+               std::to_string(options.maxBytes);
+    }
+
+    // Range transitions of one state from its target per byte class (-1 for
+    // none): the ranges of every class are sorted and touching ranges with
+    // the same target merge, so [a-z] stays one transition.
+    std::vector<std::pair<ByteRange, int>> rangeTransitions(const std::vector<int> &targetOf,
+                                                            const std::vector<std::vector<ByteRange>> &classRanges)
+    {
+        std::vector<std::pair<ByteRange, int>> ranges;
+        for (size_t cls = 0; cls < targetOf.size(); ++cls)
+            if (targetOf[cls] != -1)
+                for (ByteRange range : classRanges[cls])
+                    ranges.push_back({range, targetOf[cls]});
+        std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b)
+                  { return a.first.lo < b.first.lo; });
+
+        std::vector<std::pair<ByteRange, int>> merged;
+        for (const auto &[range, target] : ranges)
         {
-            if (!visited.count(epsNext->id))
-            {
-                startClosure.insert(epsNext);
-                q.push(epsNext);
-                visited.insert(epsNext->id);
-            }
+            if (!merged.empty() && merged.back().second == target && merged.back().first.hi + 1 == range.lo)
+                merged.back().first.hi = range.hi;
+            else
+                merged.push_back({range, target});
         }
+        return merged;
     }
+}
 
-    int startId = idCounter++;
-    stateMap[startClosure] = startId;
-    reverseMap[startId] = startClosure;
+DFABuildError::DFABuildError(Limit limit, size_t states, size_t bytes, const DFABuildOptions &options)
+    : std::runtime_error(describeLimit(limit, states, bytes, options)),
+      limit(limit), states(states), bytes(bytes), options(options)
+{
+}
 
-    DFAState startDFA;
-    startDFA.id = startId;
-    for (State *s : startClosure)
-        startDFA.nfaStates.insert(s->id);
-    for (State *s : startClosure)
-        if (s->id == nfaAcceptId)
-            startDFA.isAccept = true;
+int DFAState::next(unsigned char b) const
+{
+    auto it = std::upper_bound(transitions.begin(), transitions.end(), b, [](unsigned char v, const auto &t)
+                               { return v < t.first.lo; });
+    if (it == transitions.begin())
+        return -1;
+    --it;
+    return it->first.contains(b) ? it->second : -1;
+}
 
-    dfa.states[startId] = startDFA;
+// Rough heap footprint of a map-based DFA: one tree node per state and per
+// NFA state id, plus the transition ranges.
+size_t estimateDFABytes(const DFA &dfa)
+{
+    size_t bytes = sizeof(DFA);
+    for (const auto &[id, state] : dfa.states)
+    {
+        bytes += sizeof(DFAState) + sizeof(int) + kNodeOverhead;
+        bytes += state.nfaStates.size() * (sizeof(int) + kNodeOverhead);
+        bytes += state.transitions.size() * sizeof(state.transitions[0]);
+    }
+    return bytes;
+}
 
+// DFA conversion from NFA
+DFA convertNFAtoDFA(const FlatNFA &nfa, const DFABuildOptions &options)
+{
+    DFA dfa;
+    unordered_map<StateSet, int, StateSetHash> stateMap;
+    vector<StateSet> subsets; // DFA state ID -> NFA state set
+    EpsilonClosures closures = computeEpsilonClosures(nfa, options.maxBytes);
+    if (closures.truncated)
+        throw DFABuildError(DFABuildError::MaxBytes, 0, sizeof(DFA) + closures.bytes(), options);
     queue<int> worklist;
-    worklist.push(startId);
+
+    // NFA state -> id of the pattern it accepts, or -1.
+    vector<int> patternOf(nfa.numStates, -1);
+    if (nfa.accepts.empty())
+        patternOf[nfa.accept] = 0;
+    for (size_t i = 0; i < nfa.accepts.size(); ++i)
+        patternOf[nfa.accepts[i]] = static_cast<int>(i);
+
+    dfa.classes = computeByteClasses(nfa);
+    const vector<vector<ByteRange>> classRanges = dfa.classes.ranges();
+    const vector<pair<int, int>> edgeClasses = classSpans(dfa.classes, nfa.symRanges);
+
+    // Same accounting as estimateDFABytes, plus the closure table and the
+    // subset kept for interning.
+    size_t bytes = sizeof(DFA) + closures.bytes();
+    const size_t subsetBytes = 2 * ((nfa.numStates + 63) / 64) * sizeof(uint64_t);
+    auto charge = [&](size_t amount)
+    {
+        bytes += amount;
+        if (options.maxBytes && bytes > options.maxBytes)
+            throw DFABuildError(DFABuildError::MaxBytes, subsets.size(), bytes, options);
+    };
+
+    auto intern = [&](StateSet &&closure) -> int
+    {
+        auto it = stateMap.find(closure);
+        if (it != stateMap.end())
+            return it->second;
+
+        if (options.maxStates && subsets.size() >= options.maxStates)
+            throw DFABuildError(DFABuildError::MaxStates, subsets.size() + 1, bytes, options);
+
+        int newId = static_cast<int>(subsets.size());
+        DFAState newDFA;
+        newDFA.id = newId;
+        closure.forEach([&](uint32_t s)
+                        {
+            newDFA.nfaStates.insert(newDFA.nfaStates.end(), s);
+            if (patternOf[s] != -1)
+                newDFA.accepts.push_back(patternOf[s]); });
+        sort(newDFA.accepts.begin(), newDFA.accepts.end());
+        newDFA.isAccept = !newDFA.accepts.empty();
+        dfa.states.emplace(newId, std::move(newDFA));
+
+        const DFAState &added = dfa.states.at(newId);
+        stateMap.emplace(closure, newId);
+        subsets.push_back(std::move(closure));
+        worklist.push(newId);
+        charge(sizeof(DFAState) + sizeof(int) + kNodeOverhead + subsetBytes +
+               added.nfaStates.size() * (sizeof(int) + kNodeOverhead));
+        return newId;
+    };
+
+    dfa.startState = intern(closures.of(nfa.start));
 
     while (!worklist.empty())
     {
         int currId = worklist.front();
         worklist.pop();
-        DFAState &currDFA = dfa.states[currId];
-
-        map<char, set<State *>> transitions;
-        for (State *s : reverseMap[currId])
-        {
-            for (auto &[symbol, vec] : s->transitions)
-            {
-                if (symbol == '\0')
-                    continue;
-                for (State *dest : vec)
-                    transitions[symbol].insert(dest);
-            }
-        }
 
-        for (auto &[symbol, nextStates] : transitions)
-        {
-            set<State *> closureSet = nextStates;
-            queue<State *> q;
-            set<int> visited;
-            for (State *s : nextStates)
+        map<int, StateSet> moves; // byte class -> move + closure
+        subsets[currId].forEach([&](uint32_t s)
+                                {
+            for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
             {
-                q.push(s);
-                visited.insert(s->id);
-            }
-            while (!q.empty())
-            {
-                State *curr = q.front();
-                q.pop();
-                for (State *epsNext : curr->transitions['\0'])
+                for (int cls = edgeClasses[e].first; cls < edgeClasses[e].second; ++cls)
                 {
-                    if (!visited.count(epsNext->id))
-                    {
-                        closureSet.insert(epsNext);
-                        q.push(epsNext);
-                        visited.insert(epsNext->id);
-                    }
+                    auto it = moves.try_emplace(cls, nfa.numStates).first;
+                    closures.addTo(it->second, nfa.symTargets[e]);
                 }
-            }
-
-            if (!stateMap.count(closureSet))
-            {
-                int newId = idCounter++;
-                stateMap[closureSet] = newId;
-                reverseMap[newId] = closureSet;
-
-                DFAState newDFA;
-                newDFA.id = newId;
-                for (State *s : closureSet)
-                    newDFA.nfaStates.insert(s->id);
-                for (State *s : closureSet)
-                    if (s->id == nfaAcceptId)
-                        newDFA.isAccept = true;
-                dfa.states[newId] = newDFA;
-                worklist.push(newId);
-            }
-
-            currDFA.transitions[symbol] = stateMap[closureSet];
-        }
+            } });
+
+        // Unanchored: a match may begin at any byte, so every class moves at
+        // least to the start closure.
+        if (options.unanchored)
+            for (int cls = 0; cls < dfa.classes.count; ++cls)
+                closures.addTo(moves.try_emplace(cls, nfa.numStates).first->second, nfa.start);
+
+        vector<int> targetOf(dfa.classes.count, -1);
+        for (auto &[cls, nextStates] : moves)
+            targetOf[cls] = intern(std::move(nextStates));
+        auto &transitions = dfa.states[currId].transitions;
+        transitions = rangeTransitions(targetOf, classRanges);
+        charge(transitions.size() * sizeof(transitions[0]));
     }
 
-    dfa.startState = startId;
+    dfa.buildBytes = bytes;
     return dfa;
 }
 
+DFA convertNFAtoDFA(State *start, int nfaAcceptId)
+{
+    return convertNFAtoDFA(flattenNFA(start, nfaAcceptId));
+}
+
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
@@ -145,8 +211,8 @@ json exportDFAtoJson(const DFA &dfa)
             j["accept"].push_back(id);
         if (isDeadState(s, stateIds))
             j["dead"].push_back(id);
-        for (auto &[c, dest] : s.transitions)
-            j["transitions"].push_back({{"from", id}, {"to", dest}, {"symbol", std::string(1, c)}});
+        for (auto &[range, dest] : s.transitions)
+            j["transitions"].push_back({{"from", id}, {"to", dest}, {"symbol", rangeLabel(range)}});
     }
     return j;
 }
@@ -156,9 +222,9 @@ void printDFA(const DFA &dfa)
     for (auto &[id, s] : dfa.states)
     {
         std::cout << "State " << id << (s.isAccept ? " (accept)" : "") << ":";
-        for (auto &[c, dest] : s.transitions)
+        for (auto &[range, dest] : s.transitions)
             std::cout
-                << "  --" << c << "--> " << dest << "\n";
+                << "  --" << rangeLabel(range) << "--> " << dest << "\n";
     }
 }
 
@@ -177,18 +243,20 @@ bool simulateDFA(const DFA &dfa, const std::string &input, std::vector<int> &tra
     int current = dfa.startState;
     trace.push_back(current);
 
-    for (char c : input)
+    // Input is raw bytes: a multibyte UTF-8 character takes one step per byte.
+    for (unsigned char b : input)
     {
         if (verbose)
-            std::cout << "Current state: " << current << ", reading '" << c << "'\n";
+            std::cout << "Current state: " << current << ", reading '" << byteLabel(static_cast<char>(b)) << "'\n";
 
-        if (!dfa.states.at(current).transitions.count(c))
+        int next = dfa.states.at(current).next(b);
+        if (next == -1)
         {
             if (verbose)
-                std::cout << "[X] No transition for '" << c << "'\n";
+                std::cout << "[X] No transition for '" << byteLabel(static_cast<char>(b)) << "'\n";
             return false;
         }
-        current = dfa.states.at(current).transitions.at(c);
+        current = next;
         trace.push_back(current);
     }
 
@@ -198,107 +266,364 @@ bool simulateDFA(const DFA &dfa, const std::string &input, std::vector<int> &tra
     return dfa.states.at(current).isAccept;
 }
 
-DFA minimizeDFA(const DFA &dfa)
+DenseDFA compileDFA(const DFA &dfa)
 {
-    using Partition = std::set<int>;
-    using PartitionSet = std::set<Partition>;
-
-    // Step 1: Initial partition — accept vs non-accept
-    Partition accept, nonAccept;
+    DenseDFA dense;
+    unordered_map<int, uint32_t> indexOf;
     for (const auto &[id, state] : dfa.states)
     {
+        indexOf[id] = static_cast<uint32_t>(dense.stateIds.size());
+        dense.stateIds.push_back(id);
+    }
+    dense.dead = static_cast<uint32_t>(dense.stateIds.size());
+    dense.stateIds.push_back(-1);
+    dense.numStates = dense.dead + 1;
+    dense.start = indexOf.at(dfa.startState);
+
+    dense.classOf = dfa.classes.classOf;
+    dense.numClasses = static_cast<uint32_t>(dfa.classes.count);
+    dense.table.assign(static_cast<size_t>(dense.numStates) * dense.numClasses, dense.dead);
+    dense.acceptBits.assign((dense.numStates + 63) / 64, 0);
+    dense.acceptSets.assign(1, {});
+    dense.acceptSetOf.assign(dense.numStates, 0);
+    map<vector<int>, uint32_t> setIndex{{{}, 0}};
+    for (const auto &[id, state] : dfa.states)
+    {
+        uint32_t s = indexOf[id];
         if (state.isAccept)
-            accept.insert(id);
-        else
-            nonAccept.insert(id);
+            dense.acceptBits[s >> 6] |= uint64_t(1) << (s & 63);
+        auto [it, inserted] = setIndex.try_emplace(state.accepts, static_cast<uint32_t>(dense.acceptSets.size()));
+        if (inserted)
+            dense.acceptSets.push_back(state.accepts);
+        dense.acceptSetOf[s] = it->second;
+        for (const auto &[range, dest] : state.transitions)
+            for (int b = range.lo; b <= range.hi; ++b)
+                dense.table[static_cast<size_t>(s) * dense.numClasses + dense.classOf[b]] = indexOf.at(dest);
     }
+    return dense;
+}
 
-    std::vector<char> alphabet;
-    std::set<char> alphaSet;
-    for (const auto &[id, state] : dfa.states)
+bool simulateDFA(const DenseDFA &dfa, const std::string &input, std::vector<int> &trace)
+{
+    return simulateDFA(dfa, input.data(), input.size(), trace);
+}
+
+bool simulateDFA(const DenseDFA &dfa, const char *input, size_t length, std::vector<int> &trace)
+{
+    const uint32_t *table = dfa.table.data();
+    const uint8_t *classOf = dfa.classOf.data();
+    const size_t stride = dfa.numClasses;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    uint32_t current = dfa.start;
+    trace.push_back(dfa.stateIds[current]);
+
+    for (size_t i = 0; i < length; ++i)
     {
-        for (const auto &[sym, _] : state.transitions)
-            alphaSet.insert(sym);
+        current = table[current * stride + classOf[bytes[i]]];
+        if (current == dfa.dead)
+            return false;
+        trace.push_back(dfa.stateIds[current]);
     }
-    for (char c : alphaSet)
-        alphabet.push_back(c);
+    return dfa.isAccept(current);
+}
 
-    PartitionSet P;
-    if (!accept.empty())
-        P.insert(accept);
-    if (!nonAccept.empty())
-        P.insert(nonAccept);
+bool simulateDFA(const DenseDFA &dfa, const char *input, size_t length, CompactTrace &trace)
+{
+    const uint32_t *table = dfa.table.data();
+    const uint8_t *classOf = dfa.classOf.data();
+    const size_t stride = dfa.numClasses;
+    const size_t interval = trace.interval ? trace.interval : 1;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    uint32_t current = dfa.start;
+    trace.checkpoints.assign(1, current);
+    trace.steps = 0;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        current = table[current * stride + classOf[bytes[i]]];
+        if (current == dfa.dead)
+            return false;
+        trace.steps = i + 1;
+        if (trace.steps % interval == 0)
+            trace.checkpoints.push_back(current);
+    }
+    return dfa.isAccept(current);
+}
 
-    std::queue<std::pair<Partition, char>> workQueue;
-    for (char c : alphabet)
+vector<int> replayTrace(const DenseDFA &dfa, const char *input, const CompactTrace &trace, size_t from, size_t to)
+{
+    vector<int> states;
+    to = std::min(to, trace.steps + 1);
+    if (from >= to)
+        return states;
+    states.reserve(to - from);
+
+    const size_t interval = trace.interval ? trace.interval : 1;
+    const size_t stride = dfa.numClasses;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    size_t position = from / interval * interval;
+    uint32_t current = trace.checkpoints[from / interval];
+    for (; position < from; ++position)
+        current = dfa.table[current * stride + dfa.classOf[bytes[position]]];
+
+    states.push_back(dfa.stateIds[current]);
+    for (; position + 1 < to; ++position)
     {
-        if (!accept.empty())
-            workQueue.push({accept, c});
-        if (!nonAccept.empty())
-            workQueue.push({nonAccept, c});
+        current = dfa.table[current * stride + dfa.classOf[bytes[position]]];
+        states.push_back(dfa.stateIds[current]);
     }
+    return states;
+}
+
+bool matchDFA(const DenseDFA &dfa, const std::string &input)
+{
+    return matchDFA(dfa, input.data(), input.size());
+}
 
-    while (!workQueue.empty())
+bool matchDFA(const DenseDFA &dfa, const char *input, size_t length)
+{
+    const uint32_t *table = dfa.table.data();
+    const uint8_t *classOf = dfa.classOf.data();
+    const size_t stride = dfa.numClasses;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    uint32_t current = dfa.start;
+    for (size_t i = 0; i < length; ++i)
     {
-        auto [A, c] = workQueue.front();
-        workQueue.pop();
+        current = table[current * stride + classOf[bytes[i]]];
+        if (current == dfa.dead)
+            return false;
+    }
+    return dfa.isAccept(current);
+}
 
-        std::map<Partition, Partition> newPartitions;
-        for (const auto &Y : P)
-        {
-            Partition Y1, Y2;
-            for (int q : Y)
-            {
-                const auto &trans = dfa.states.at(q).transitions;
-                if (trans.count(c) && A.count(trans.at(c)))
-                    Y1.insert(q);
-                else
-                    Y2.insert(q);
-            }
+const vector<int> &matchingPatterns(const DenseDFA &dfa, const char *input, size_t length)
+{
+    const uint32_t *table = dfa.table.data();
+    const uint8_t *classOf = dfa.classOf.data();
+    const size_t stride = dfa.numClasses;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    uint32_t current = dfa.start;
+    for (size_t i = 0; i < length && current != dfa.dead; ++i)
+        current = table[current * stride + classOf[bytes[i]]];
+    return dfa.acceptSets[dfa.acceptSetOf[current]];
+}
 
-            if (!Y1.empty() && !Y2.empty())
+// Hopcroft's algorithm over a refinable partition. States are renumbered
+// 0..n-1 and a sink state n completes the transition function; blocks are
+// contiguous ranges of `elems`, and splitting a block only touches the states
+// that were marked. Only the smaller half of each split is queued as a new
+// splitter, which gives O(k n log n) for k symbols.
+DFA minimizeDFA(const DFA &dfa)
+{
+    vector<const DFAState *> states; // index -> original state
+    unordered_map<int, int> indexOf;  // original state id -> index
+    indexOf.reserve(dfa.states.size());
+    for (const auto &[id, state] : dfa.states)
+    {
+        indexOf[id] = static_cast<int>(states.size());
+        states.push_back(&state);
+    }
+    const int n = static_cast<int>(states.size());
+    const int sink = n;
+    const int total = n + 1;
+
+    // Symbols are the byte classes that label at least one transition. Every
+    // range is a union of whole classes, so its classes are found from their
+    // smallest bytes.
+    vector<int> alphabet; // symbol -> byte class
+    vector<int> symbolOf(dfa.classes.count, -1);
+    vector<vector<pair<int, int>>> spans(n); // per state, class ids of each transition
+    for (int q = 0; q < n; ++q)
+    {
+        vector<ByteRange> ranges;
+        for (const auto &[range, _] : states[q]->transitions)
+            ranges.push_back(range);
+        spans[q] = classSpans(dfa.classes, ranges);
+        for (auto [lo, hi] : spans[q])
+        {
+            for (int cls = lo; cls < hi; ++cls)
             {
-                P.erase(Y);
-                P.insert(Y1);
-                P.insert(Y2);
-                for (char a : alphabet)
+                if (symbolOf[cls] == -1)
                 {
-                    workQueue.push({Y1, a});
-                    workQueue.push({Y2, a});
+                    symbolOf[cls] = static_cast<int>(alphabet.size());
+                    alphabet.push_back(cls);
                 }
-                break;
             }
         }
     }
+    const int k = static_cast<int>(alphabet.size());
 
-    // Step 2: Build new minimized DFA
-    std::map<int, int> stateToGroup;
-    int groupId = 0;
-    std::map<Partition, int> groupMap;
+    // Complete transition function and its inverse in CSR form per symbol:
+    // the a-predecessors of q are invSources[invOffsets[a * (total + 1) + q] ..].
+    vector<int> delta(static_cast<size_t>(total) * k, sink);
+    for (int q = 0; q < n; ++q)
+    {
+        for (size_t t = 0; t < spans[q].size(); ++t)
+        {
+            int dest = indexOf.at(states[q]->transitions[t].second);
+            for (int cls = spans[q][t].first; cls < spans[q][t].second; ++cls)
+                delta[static_cast<size_t>(q) * k + symbolOf[cls]] = dest;
+        }
+    }
 
-    for (const auto &block : P)
+    vector<int> invOffsets(static_cast<size_t>(k) * (total + 1) + 1, 0);
+    vector<int> invSources(static_cast<size_t>(total) * k);
+    for (int q = 0; q < total; ++q)
+        for (int a = 0; a < k; ++a)
+            invOffsets[static_cast<size_t>(a) * (total + 1) + delta[static_cast<size_t>(q) * k + a] + 1]++;
+    for (size_t i = 1; i < invOffsets.size(); ++i)
+        invOffsets[i] += invOffsets[i - 1];
     {
-        for (int id : block)
-            stateToGroup[id] = groupId;
-        groupMap[block] = groupId++;
+        vector<int> fill(invOffsets.begin(), invOffsets.end() - 1);
+        for (int q = 0; q < total; ++q)
+            for (int a = 0; a < k; ++a)
+                invSources[fill[static_cast<size_t>(a) * (total + 1) + delta[static_cast<size_t>(q) * k + a]]++] = q;
     }
 
-    DFA minDFA;
-    for (const auto &[block, gid] : groupMap)
+    // Refinable partition: block b owns elems[first[b] .. past[b]), and during a
+    // split its marked states are gathered in elems[first[b] .. mid[b]). The
+    // initial blocks group states by accept set; the sink accepts nothing.
+    vector<int> elems(total), loc(total), blockOf(total);
+    vector<int> first, past, mid;
     {
-        DFAState newState;
-        newState.id = gid;
+        static const vector<int> none;
+        map<vector<int>, int> blockOfSet;
+        vector<int> sizes;
+        for (int q = 0; q < total; ++q)
+        {
+            const vector<int> &accepts = q < n ? states[q]->accepts : none;
+            auto [it, inserted] = blockOfSet.try_emplace(accepts, static_cast<int>(sizes.size()));
+            if (inserted)
+                sizes.push_back(0);
+            blockOf[q] = it->second;
+            sizes[it->second]++;
+        }
+        int pos = 0;
+        for (int size : sizes)
+        {
+            first.push_back(pos);
+            past.push_back(pos + size);
+            mid.push_back(pos);
+            pos += size;
+        }
+        for (int q = 0; q < total; ++q)
+        {
+            int b = blockOf[q];
+            elems[mid[b]] = q;
+            loc[q] = mid[b]++;
+        }
+        mid = first;
+    }
+
+    // Every initial block but the largest is a splitter.
+    vector<pair<int, int>> workList; // (block, symbol)
+    {
+        int largest = 0;
+        for (int b = 1; b < (int)first.size(); ++b)
+            if (past[b] - first[b] > past[largest] - first[largest])
+                largest = b;
+        for (int b = 0; b < (int)first.size(); ++b)
+            if (b != largest)
+                for (int a = 0; a < k; ++a)
+                    workList.push_back({b, a});
+    }
+
+    vector<int> predecessors, touched;
+    while (!workList.empty())
+    {
+        auto [splitter, a] = workList.back();
+        workList.pop_back();
+
+        predecessors.clear();
+        for (int i = first[splitter]; i < past[splitter]; ++i)
+        {
+            int q = elems[i];
+            size_t row = static_cast<size_t>(a) * (total + 1) + q;
+            predecessors.insert(predecessors.end(), invSources.begin() + invOffsets[row], invSources.begin() + invOffsets[row + 1]);
+        }
 
-        // Representative state (any) for transitions and accept
-        int rep = *block.begin();
-        newState.isAccept = dfa.states.at(rep).isAccept;
+        touched.clear();
+        for (int p : predecessors)
+        {
+            int b = blockOf[p];
+            if (mid[b] == first[b])
+                touched.push_back(b);
+            int target = mid[b]++;
+            int other = elems[target];
+            swap(elems[loc[p]], elems[target]);
+            loc[other] = loc[p];
+            loc[p] = target;
+        }
 
-        for (auto [sym, dest] : dfa.states.at(rep).transitions)
-            newState.transitions[sym] = stateToGroup[dest];
+        for (int b : touched)
+        {
+            int marked = mid[b] - first[b];
+            int unmarked = past[b] - mid[b];
+            if (unmarked == 0)
+            {
+                mid[b] = first[b];
+                continue;
+            }
 
-        minDFA.states[gid] = newState;
+            int c = static_cast<int>(first.size());
+            if (marked <= unmarked)
+            {
+                first.push_back(first[b]);
+                past.push_back(mid[b]);
+                first[b] = mid[b];
+            }
+            else
+            {
+                first.push_back(mid[b]);
+                past.push_back(past[b]);
+                past[b] = mid[b];
+            }
+            mid.push_back(first[c]);
+            mid[b] = first[b];
+            for (int i = first[c]; i < past[c]; ++i)
+                blockOf[elems[i]] = c;
+            for (int x = 0; x < k; ++x)
+                workList.push_back({c, x});
+        }
+    }
+
+    // Build the minimized DFA. Blocks are numbered in order of their smallest
+    // original state id; the sink's block only survives if it holds the start.
+    int sinkBlock = blockOf[sink];
+    bool keepSink = blockOf[indexOf.at(dfa.startState)] == sinkBlock;
+    vector<int> groupOf(first.size(), -1);
+    int groupId = 0;
+    DFA minDFA;
+    minDFA.classes = dfa.classes;
+    const vector<vector<ByteRange>> classRanges = dfa.classes.ranges();
+    for (int q = 0; q < n; ++q)
+    {
+        int b = blockOf[q];
+        if (groupOf[b] != -1 || (b == sinkBlock && !keepSink))
+            continue;
+        groupOf[b] = groupId;
+
+        DFAState newState;
+        newState.id = groupId;
+        newState.isAccept = states[q]->isAccept;
+        newState.accepts = states[q]->accepts;
+        minDFA.states.emplace_hint(minDFA.states.end(), groupId++, std::move(newState));
+    }
+    for (int q = 0; q < n; ++q)
+    {
+        int b = blockOf[q];
+        if (groupOf[b] == -1 || elems[first[b]] != q)
+            continue;
+        vector<int> targetOf(dfa.classes.count, -1);
+        for (int a = 0; a < k; ++a)
+        {
+            int dest = blockOf[delta[static_cast<size_t>(q) * k + a]];
+            if (dest != sinkBlock)
+                targetOf[alphabet[a]] = groupOf[dest];
+        }
+        minDFA.states[groupOf[b]].transitions = rangeTransitions(targetOf, classRanges);
     }
 
-    minDFA.startState = stateToGroup[dfa.startState];
+    minDFA.startState = groupOf[blockOf[indexOf.at(dfa.startState)]];
     return minDFA;
 }
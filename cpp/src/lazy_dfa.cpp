@@ -0,0 +1,108 @@
+#include "lazy_dfa.h"
+#include "dfa.h"
+#include <utility>
+
+LazyDFA::LazyDFA(FlatNFA nfa, LazyDFAOptions options)
+    : nfa(std::move(nfa)), options(options)
+{
+    closures = computeEpsilonClosures(this->nfa, options.maxClosureBytes);
+    if (closures.truncated)
+    {
+        DFABuildOptions limits;
+        limits.maxBytes = options.maxClosureBytes;
+        throw DFABuildError(DFABuildError::MaxBytes, 0, closures.bytes(), limits);
+    }
+    classes = computeByteClasses(this->nfa);
+    edgeClasses = classSpans(classes, this->nfa.symRanges);
+}
+
+// Approximate footprint of one cached state: the state itself plus the NFA
+// state set stored both in the cache and as the index key.
+size_t LazyDFA::stateBytes() const
+{
+    size_t setBytes = ((nfa.numStates + 63) / 64) * sizeof(uint64_t);
+    return sizeof(CachedState) + classes.count * sizeof(int) + 2 * setBytes + 4 * sizeof(void *);
+}
+
+int LazyDFA::intern(StateSet &&set)
+{
+    auto it = index.find(set);
+    if (it != index.end())
+        return it->second;
+
+    int id = static_cast<int>(cache.size());
+    CachedState state;
+    state.isAccept = set.contains(nfa.accept);
+    state.isDead = set.empty();
+    state.next.assign(classes.count, kUnknown);
+    index.emplace(set, id);
+    state.nfaStates = std::move(set);
+    cache.push_back(std::move(state));
+
+    stats_.statesBuilt++;
+    stats_.cacheBytes += stateBytes();
+    return id;
+}
+
+StateSet LazyDFA::move(const StateSet &from, int cls) const
+{
+    StateSet to(nfa.numStates);
+    from.forEach([&](uint32_t s)
+                 {
+        for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
+            if (edgeClasses[e].first <= cls && cls < edgeClasses[e].second)
+                closures.addTo(to, nfa.symTargets[e]); });
+    return to;
+}
+
+void LazyDFA::clearCache()
+{
+    cache.clear();
+    index.clear();
+    startState = kUnknown;
+    stats_.cacheBytes = 0;
+    stats_.cacheClears++;
+}
+
+bool LazyDFA::match(const std::string &input)
+{
+    stats_.fellBack = false;
+    if (startState == kUnknown)
+        startState = intern(closures.of(nfa.start));
+
+    int clears = 0;
+    int current = startState;
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        int cls = classes.classOf[static_cast<unsigned char>(input[i])];
+        int next = cache[current].next[cls];
+        if (next == kUnknown)
+        {
+            StateSet target = move(cache[current].nfaStates, cls);
+            bool cleared = false;
+            // Only a state that is not cached yet can overrun the budget.
+            auto cached = index.find(target);
+            if (cached == index.end() && stats_.cacheBytes + stateBytes() > options.memoryBudget)
+            {
+                if (clears >= options.maxCacheClears)
+                {
+                    // The cache is thrashing: finish on NFA simulation.
+                    stats_.fellBack = true;
+                    for (++i; i < input.size() && !target.empty(); ++i)
+                        target = move(target, classes.classOf[static_cast<unsigned char>(input[i])]);
+                    return target.contains(nfa.accept);
+                }
+                clearCache();
+                clears++;
+                cleared = true;
+            }
+            next = cached != index.end() ? cached->second : intern(std::move(target));
+            if (!cleared)
+                cache[current].next[cls] = next;
+        }
+        current = next;
+        if (cache[current].isDead)
+            return false;
+    }
+    return cache[current].isAccept;
+}
@@ -1,12 +1,24 @@
 #include "nfa.h"
 #include "dfa.h"
+#include "lazy_dfa.h"
+#include "serve.h"
+#include "pattern_cache.h"
+#include "batch.h"
+#include "mapped_file.h"
+#include "simd.h"
+#include "search.h"
+#include "pattern_set.h"
+#include "shift_and.h"
+#include "pike_vm.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <filesystem>
 #include <cstdlib>
-#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <cstring>
 
 void runInteractive()
 {
@@ -14,16 +26,16 @@ void runInteractive()
     std::cout << "Enter regex: ";
     std::cin >> regex;
 
-    NFA nfa = regexToNFA(regex);
+    auto pattern = globalPatternCache().get(regex);
     std::cout << "\nNFA transitions:\n";
-    printNFA(nfa.start);
+    printNFA(pattern->nfa);
 
     std::ofstream f1("output/nfa.json");
-    f1 << exportToJson(nfa.start).dump(4);
+    f1 << exportToJson(pattern->nfa).dump(4);
     std::cout << "[OK] NFA JSON saved to output/nfa.json\n";
     f1.close();
 
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    const DFA &dfa = pattern->dfa;
     std::cout << "\nDFA transitions:\n";
     printDFA(dfa);
 
@@ -49,6 +61,19 @@ void runInteractive()
     std::cout << "\nResult: " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
 }
 
+// Consumes --max-states N / --max-bytes N at argv[i]; returns false for other flags.
+bool parseLimitFlag(int &i, int argc, char *argv[], DFABuildOptions &limits)
+{
+    std::string flag = argv[i];
+    if (flag == "--max-states" && i + 1 < argc)
+        limits.maxStates = std::stoull(argv[++i]);
+    else if (flag == "--max-bytes" && i + 1 < argc)
+        limits.maxBytes = std::stoull(argv[++i]);
+    else
+        return false;
+    return true;
+}
+
 void runBatchTests()
 {
     std::vector<std::string> testCases = {
@@ -58,8 +83,9 @@ void runBatchTests()
     for (const auto &regex : testCases)
     {
         std::cout << "===== Testing regex: " << regex << " =====\n";
-        NFA nfa = regexToNFA(regex);
-        DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+        auto pattern = globalPatternCache().get(regex);
+        const DFA &dfa = pattern->dfa;
+        std::cout << "NFA: " << pattern->nfa.stateCount() << " states, " << pattern->nfa.arenaBytes() << " bytes peak\n";
         printDFA(dfa);
 
         for (const auto &input : inputs)
@@ -77,29 +103,32 @@ void runBatchTests()
         }
         std::cout << "\n";
     }
+
+    PatternCacheStats stats = globalPatternCache().stats();
+    std::cout << "Pattern cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions, " << stats.bytes << " bytes\n";
 }
 
 void runDFAMode(const std::string &regex)
 {
     std::cout << "Generating DFA for: " << regex << "\n";
-    NFA nfa = regexToNFA(regex);
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    auto pattern = globalPatternCache().get(regex);
+    std::cout << "NFA: " << pattern->nfa.stateCount() << " states, " << pattern->nfa.arenaBytes() << " bytes peak\n";
 
     std::filesystem::create_directories("output");
 
     std::ofstream f("output/dfa.json");
-    f << exportDFAtoJson(dfa).dump(4);
+    f << exportDFAtoJson(pattern->dfa).dump(4);
     std::cout << "[OK] DFA JSON saved to output/dfa.json\n";
     f.close();
 }
 
-void runSimulateMode(const std::string &regex, const std::string &input, bool verbose, bool minimized)
+void runSimulateMode(const std::string &regex, const std::string &input, bool verbose, bool minimized,
+                     const DFABuildOptions &limits)
 {
     std::cout << "Simulating " << (minimized ? "MINIMIZED " : "") << "DFA for regex: " << regex << " on input: " << input << "\n";
-    NFA nfa = regexToNFA(regex);
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
-    if (minimized)
-        dfa = minimizeDFA(dfa);
+    auto pattern = globalPatternCache().get(regex, limits);
+    const DFA &dfa = minimized ? pattern->minDFA : pattern->dfa;
 
     std::vector<int> trace;
     printDFA(dfa);
@@ -115,26 +144,67 @@ void runSimulateMode(const std::string &regex, const std::string &input, bool ve
     std::cout << "\nResult: " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
 }
 
-void runFileMode(const std::string &filename)
+void runLazySimulateMode(const std::string &regex, const std::string &input, const LazyDFAOptions &options)
 {
-    std::ifstream infile(filename);
-    if (!infile)
+    std::cout << "Simulating LAZY DFA for regex: " << regex << " on input: " << input << "\n";
+    LazyDFA lazy(flattenNFA(regexToNFA(regex)), options);
+    bool accepted = lazy.match(input);
+
+    const LazyDFAStats &stats = lazy.stats();
+    std::cout << "Lazy DFA: " << stats.statesBuilt << " states built, "
+              << stats.cacheClears << " cache clears, "
+              << stats.cacheBytes << " bytes cached"
+              << (stats.fellBack ? ", fell back to NFA simulation" : "") << "\n";
+    std::cout << "Result: " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
+}
+
+void runShiftAndSimulateMode(const std::string &regex, const std::string &input, const GlushkovNFA &nfa)
+{
+    std::cout << "Simulating SHIFT-AND (Glushkov, " << nfa.positions() << " positions) for regex: " << regex
+              << " on input: " << input << "\n";
+    bool accepted = ShiftAndMatcher(nfa).match(input);
+    std::cout << "Result: " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
+}
+
+void runPikeSimulateMode(const std::string &regex, const std::string &input)
+{
+    PikeVM vm(flattenNFA(regexToNFA(regex)));
+    std::cout << "Simulating PIKE VM (" << vm.programSize() << " instructions) for regex: " << regex
+              << " on input: " << input << "\n";
+    bool accepted = vm.match(input);
+    std::cout << "Result: " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
+}
+
+void runFileMode(const std::string &filename, BatchOptions options)
+{
+    MappedFile input(filename);
+    if (!input.ok())
     {
         std::cerr << "[X] Cannot open file: " << filename << "\n";
         return;
     }
 
-    std::string regex;
-    if (!std::getline(infile, regex))
+    if (input.size() == 0)
     {
         std::cerr << "[X] Empty file or missing regex.\n";
         return;
     }
 
-    NFA nfa = regexToNFA(regex);
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
-
-    std::ofstream outfile("output/result.txt");
+    // The first line is the regex; the rest is matched in place.
+    const char *data = input.data();
+    const char *newline = static_cast<const char *>(memchr(data, '\n', input.size()));
+    size_t regexLength = newline ? static_cast<size_t>(newline - data) : input.size();
+    std::string regex(data, regexLength);
+    size_t bodyOffset = newline ? regexLength + 1 : input.size();
+
+    // Without traces the minimized DFA is used: it is the fastest to step and
+    // the most likely to fit the 16-state SIMD lanes.
+    auto pattern = globalPatternCache().get(regex);
+    const DenseDFA &dfa = options.traces ? pattern->dense : pattern->denseMin;
+    if (!options.traces)
+        options.prefilter = pattern->literal;
+
+    std::ofstream outfile("output/result.txt", std::ios::binary);
     if (!outfile)
     {
         std::cerr << "[X] Cannot write to output/result.txt\n";
@@ -142,37 +212,106 @@ void runFileMode(const std::string &filename)
     }
 
     outfile << "Regex: " << regex << "\n\n";
-    std::string line;
-    while (std::getline(infile, line))
+    BatchStats stats = runBatch(dfa, data + bodyOffset, input.size() - bodyOffset, outfile, options);
+
+    std::cout << "[OK] Results saved to output/result.txt\n";
+    std::cout << "[OK] " << stats.lines << " lines, " << stats.bytes << " bytes in " << stats.seconds << " s on "
+              << options.threads << " threads (";
+    // A tiny or empty input can finish below the clock's resolution.
+    if (stats.seconds > 0)
+        std::cout << static_cast<size_t>(stats.lines / stats.seconds) << " lines/s, " << stats.bytes / stats.seconds / 1e6 << " MB/s, ";
+    else
+        std::cout << "n/a lines/s, n/a MB/s, ";
+    std::cout << simdLevel() << ")\n";
+    if (!options.prefilter.empty())
+        std::cout << "[OK] Prefilter \"" << options.prefilter << "\": " << stats.prefilterHits << "/" << stats.lines
+                  << " lines reached the DFA (" << (stats.lines ? 100.0 * stats.prefilterHits / stats.lines : 0.0) << "% hit rate)\n";
+}
+
+void runSearchMode(const std::string &regex, const std::string &filename, bool all)
+{
+    MappedFile input(filename);
+    if (!input.ok())
+    {
+        std::cerr << "[X] Cannot open file: " << filename << "\n";
+        return;
+    }
+
+    Searcher searcher(flattenNFA(regexToNFA(regex)));
+    auto print = [&](const Match &m)
     {
-        std::vector<int> trace;
-        bool accepted = simulateDFA(dfa, line, trace);
+        std::cout << "[" << m.start << ", " << m.end << "): \""
+                  << std::string(input.data() + m.start, m.end - m.start) << "\"\n";
+    };
 
-        outfile << "Input: \"" << line << "\" => ";
-        for (size_t i = 0; i < trace.size(); ++i)
+    if (!all)
+    {
+        Match match;
+        if (searcher.find(input.data(), input.size(), match))
         {
-            outfile << trace[i];
-            if (i + 1 < trace.size())
-                outfile << " -> ";
+            std::cout << "[OK] Leftmost-longest match at ";
+            print(match);
         }
-        outfile << " => " << (accepted ? "[OK] Accepted" : "[X] Rejected") << "\n";
+        else
+        {
+            std::cout << "[X] No match for " << regex << "\n";
+        }
+        return;
     }
 
-    std::cout << "[OK] Results saved to output/result.txt\n";
+    std::vector<Match> matches = searcher.findAll(input.data(), input.size());
+    for (const Match &m : matches)
+        print(m);
+    std::cout << "[OK] " << matches.size() << " matches for " << regex << "\n";
+}
+
+void runPatternSetMode(const std::string &patternsFile, const std::string &inputFile)
+{
+    std::ifstream patternsIn(patternsFile);
+    MappedFile input(inputFile);
+    if (!patternsIn || !input.ok())
+    {
+        std::cerr << "[X] Cannot open file: " << (patternsIn ? inputFile : patternsFile) << "\n";
+        return;
+    }
+
+    std::vector<std::string> regexes;
+    for (std::string line; std::getline(patternsIn, line);)
+        if (!line.empty())
+            regexes.push_back(line);
+
+    PatternSet set = compilePatternSet(regexes);
+    std::cout << "Pattern set: " << regexes.size() << " patterns, " << set.dfa.states.size() << " DFA states\n";
+
+    const char *data = input.data(), *end = input.data() + input.size();
+    size_t lines = 0;
+    while (data < end)
+    {
+        const char *lineEnd = findNewline(data, end);
+        const std::vector<int> &ids = set.match(data, static_cast<size_t>(lineEnd - data));
+        std::cout << "Input: \"" << std::string(data, lineEnd) << "\" => ";
+        if (ids.empty())
+            std::cout << "[X] No pattern";
+        for (size_t i = 0; i < ids.size(); ++i)
+            std::cout << (i ? ", " : "[OK] ") << ids[i] << " " << regexes[ids[i]];
+        std::cout << "\n";
+        lines++;
+        data = lineEnd + 1;
+    }
+    std::cout << "[OK] " << lines << " lines matched against " << regexes.size() << " patterns in one pass each\n";
 }
 
 void runVisualizeAll(const std::string &regex)
 {
     std::cout << "Generating and visualizing NFA + DFA for: " << regex << "\n";
 
-    NFA nfa = regexToNFA(regex);
+    auto pattern = globalPatternCache().get(regex);
     std::ofstream f1("output/nfa.json");
-    f1 << exportToJson(nfa.start).dump(4);
+    f1 << exportToJson(pattern->nfa).dump(4);
     f1.close();
 
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
     std::ofstream f2("output/dfa.json");
-    f2 << exportDFAtoJson(dfa).dump(4);
+    f2 << exportDFAtoJson(pattern->dfa).dump(4);
     f2.close();
 
     std::cout << "[OK] JSONs exported.\nRendering images...\n";
@@ -190,14 +329,12 @@ void runVisualizeMinimizedDFA(const std::string &regex)
 {
     std::cout << "Generating and visualizing MINIMIZED DFA for: " << regex << "\n";
 
-    NFA nfa = regexToNFA(regex);
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
-    DFA minDFA = minimizeDFA(dfa);
+    auto pattern = globalPatternCache().get(regex);
 
     std::filesystem::create_directories("output");
 
     std::ofstream f("output/min_dfa.json");
-    f << exportDFAtoJson(minDFA).dump(4);
+    f << exportDFAtoJson(pattern->minDFA).dump(4);
     f.close();
 
     std::cout << "[OK] Minimized DFA JSON exported.\nRendering minimized DFA image...\n";
@@ -209,7 +346,7 @@ void runVisualizeMinimizedDFA(const std::string &regex)
         std::cerr << "[X] Visualization failed. Ensure Python & graphviz are installed.\n";
 }
 
-int main(int argc, char *argv[])
+static int run(int argc, char *argv[])
 {
     if (argc > 1)
     {
@@ -226,21 +363,104 @@ int main(int argc, char *argv[])
         {
             bool traceFlag = false;
             bool minimized = false;
+            std::string engine = "eager"; // the DFA and trace output --simulate always printed
+            LazyDFAOptions lazyOptions;
+            DFABuildOptions limits = defaultBuildLimits();
 
             for (int i = 4; i < argc; ++i)
             {
                 std::string flag = argv[i];
+                if (parseLimitFlag(i, argc, argv, limits))
+                    continue;
                 if (flag == "--trace")
                     traceFlag = true;
                 else if (flag == "--min")
                     minimized = true;
+                else if (flag == "--engine" && i + 1 < argc)
+                    engine = argv[++i];
+                else if (flag == "--cache-bytes" && i + 1 < argc)
+                    lazyOptions.memoryBudget = std::stoull(argv[++i]);
             }
 
-            runSimulateMode(argv[2], argv[3], traceFlag, minimized);
+            // --engine auto: small patterns that need no DFA trace skip DFA
+            // construction, and those whose eager DFA could pass max_bytes go
+            // straight to the lazy one. The size estimate decides before any
+            // automaton is built.
+            RegexAST ast = parseRegex(argv[2]);
+            RegexSize size = estimateRegexSize(ast);
+            if (limits.maxBytes && size.nfaBytes() > limits.maxBytes)
+            {
+                std::cerr << "[X] " << DFABuildError(DFABuildError::MaxBytes, 0, size.nfaBytes(), limits).what() << "\n";
+                return 1;
+            }
+            bool fits = size.positions <= ShiftAndMatcher::kMaxPositions;
+            bool dfaMayOverrun = limits.maxBytes && size.dfaBytesBound > limits.maxBytes;
+            if (engine == "auto")
+                engine = traceFlag || minimized ? "eager" : fits ? "shift-and" : dfaMayOverrun ? "lazy" : "eager";
+            if (limits.maxBytes)
+            {
+                lazyOptions.memoryBudget = std::min(lazyOptions.memoryBudget, limits.maxBytes);
+                lazyOptions.maxClosureBytes = limits.maxBytes;
+            }
+            if (engine == "shift-and" && !fits)
+            {
+                std::cerr << "[X] Pattern has " << size.positions << " positions; shift-and handles at most "
+                          << ShiftAndMatcher::kMaxPositions << "\n";
+                return 1;
+            }
+            GlushkovNFA glushkov;
+            if (engine == "shift-and")
+                glushkov = regexToGlushkov(ast);
+
+            if (engine == "lazy")
+                runLazySimulateMode(argv[2], argv[3], lazyOptions);
+            else if (engine == "shift-and")
+                runShiftAndSimulateMode(argv[2], argv[3], glushkov);
+            else if (engine == "pike")
+                runPikeSimulateMode(argv[2], argv[3]);
+            else
+            {
+                try
+                {
+                    runSimulateMode(argv[2], argv[3], traceFlag, minimized, limits);
+                }
+                catch (const DFABuildError &e)
+                {
+                    std::cerr << "[X] " << e.what() << "; falling back to the lazy engine\n";
+                    runLazySimulateMode(argv[2], argv[3], lazyOptions);
+                }
+            }
+        }
+        else if (mode == "--serve")
+        {
+            DFABuildOptions limits = defaultBuildLimits();
+            for (int i = 2; i < argc; ++i)
+                parseLimitFlag(i, argc, argv, limits);
+            runServeMode(std::cin, std::cout, limits);
         }
         else if (mode == "--file" && argc > 2)
         {
-            runFileMode(argv[2]);
+            BatchOptions batchOptions;
+            batchOptions.threads = std::max(1u, std::thread::hardware_concurrency());
+            for (int i = 3; i < argc; ++i)
+            {
+                std::string flag = argv[i];
+                if (flag == "--threads" && i + 1 < argc)
+                    batchOptions.threads = std::max(1, std::stoi(argv[++i]));
+                else if (flag == "--no-trace")
+                    batchOptions.traces = false;
+                else if (flag == "--simd-lanes")
+                    batchOptions.simdLanes = true;
+            }
+            runFileMode(argv[2], batchOptions);
+        }
+        else if ((mode == "--search" || mode == "--find-all") && argc > 3)
+        {
+            runSearchMode(argv[2], argv[3], mode == "--find-all");
+        }
+        else if (mode == "--patterns" && argc > 3)
+        {
+            runPatternSetMode(argv[2], argv[3]);
         }
         else if (mode == "--visualize" && argc > 2)
         {
@@ -252,14 +472,11 @@ int main(int argc, char *argv[])
         }
         else if (mode == "--minimize" && argc > 2)
         {
-            std::string regex = argv[2];
-            NFA nfa = regexToNFA(regex);
-            DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
-            DFA minDFA = minimizeDFA(dfa);
+            auto pattern = globalPatternCache().get(argv[2]);
 
             std::filesystem::create_directories("output");
             std::ofstream f("output/min_dfa.json");
-            f << exportDFAtoJson(minDFA).dump(4);
+            f << exportDFAtoJson(pattern->minDFA).dump(4);
             f.close();
             std::cout << "[OK] Minimized DFA JSON saved to output/min_dfa.json\n";
         }
@@ -270,7 +487,18 @@ int main(int argc, char *argv[])
                       << "  ./main --test                      (batch tests)\n"
                       << "  ./main --dfa REGEX                 (export DFA JSON to output/dfa.json)\n"
                       << "  ./main --simulate R S [--trace] [--min]   (run DFA on input S with optional trace and minimized mode)\n"
-                      << "  ./main --file input.txt            (evaluate all strings in input.txt)\n"
+                      << "         [--engine eager|auto|lazy|shift-and|pike] [--cache-bytes N]   (eager, the default: print the DFA and trace;\n"
+                      << "                                     lazy: build DFA states on demand in an N-byte cache;\n"
+                      << "                                     shift-and: bit-parallel Glushkov NFA, picked by auto for short patterns;\n"
+                      << "                                     pike: NFA simulation in O(n*m) without DFA states)\n"
+                      << "         [--max-states N] [--max-bytes N]   (abort DFA construction past N states / bytes and fall back to lazy;\n"
+                      << "                                     max-bytes defaults to 64 MB, 0 lifts it)\n"
+                      << "  ./main --file input.txt [--threads N] [--no-trace] [--simd-lanes]   (evaluate all strings in input.txt on N threads;\n"
+                      << "                                     --simd-lanes steps 16 lines at once for DFAs of up to 16 states)\n"
+                      << "  ./main --search R input.txt        (leftmost-longest occurrence of R anywhere in input.txt)\n"
+                      << "  ./main --find-all R input.txt      (every non-overlapping occurrence of R)\n"
+                      << "  ./main --patterns P input.txt      (report which regexes of file P, one per line, match each line)\n"
+                      << "  ./main --serve [--max-states N] [--max-bytes N]   (answer newline-delimited JSON requests on stdin)\n"
                       << "  ./main --visualize REGEX           (generate NFA + DFA images)\n"
                       << "  ./main --visualize-min REGEX       (generate minimized DFA image)\n"
                       << "  ./main --minimize REGEX            (export minimized DFA JSON to output/min_dfa.json)\n";
@@ -282,3 +510,21 @@ int main(int argc, char *argv[])
     }
     return 0;
 }
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        return run(argc, argv);
+    }
+    catch (const RegexParseError &e)
+    {
+        std::cerr << "[X] Invalid regex: " << e.what() << "\n";
+        return 1;
+    }
+    catch (const DFABuildError &e)
+    {
+        std::cerr << "[X] " << e.what() << "\n";
+        return 1;
+    }
+}
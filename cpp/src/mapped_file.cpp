@@ -0,0 +1,59 @@
+#include "mapped_file.h"
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifdef HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            length = static_cast<size_t>(st.st_size);
+            if (length == 0)
+            {
+                valid = true;
+            }
+            else
+            {
+                void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED)
+                {
+                    madvise(addr, length, MADV_SEQUENTIAL);
+                    begin = static_cast<const char *>(addr);
+                    valid = mapped = true;
+                }
+            }
+        }
+        close(fd);
+        if (valid)
+            return;
+        length = 0;
+    }
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return;
+    fallback.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    begin = fallback.data();
+    length = fallback.size();
+    valid = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+    if (mapped)
+        munmap(const_cast<char *>(begin), length);
+#endif
+}
@@ -2,168 +2,1202 @@
 #include <stack>
 #include <iostream>
 #include <set>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
 
-static int stateId = 0;
-
-State *createState()
+State *StateArena::allocate()
 {
-    State *s = new State();
-    s->id = stateId++;
+    if (count == blocks.size() * kBlockStates)
+        blocks.emplace_back(new State[kBlockStates]);
+    State *s = &blocks.back()[count % kBlockStates];
+    s->id = static_cast<int>(count++);
     return s;
 }
 
-NFA singleCharNFA(char c)
+State *StateArena::at(int id) const
+{
+    return &blocks[id / kBlockStates][id % kBlockStates];
+}
+
+size_t StateArena::bytesReserved() const
+{
+    size_t bytes = blocks.size() * kBlockStates * sizeof(State) +
+                   blocks.capacity() * sizeof(std::unique_ptr<State[]>);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const State *s = at(static_cast<int>(i));
+        bytes += s->epsilon.capacity() * sizeof(s->epsilon[0]) + s->transitions.capacity() * sizeof(s->transitions[0]);
+    }
+    return bytes;
+}
+
+// A Thompson fragment under construction; the states belong to the arena.
+struct Fragment
 {
-    State *start = createState();
-    State *accept = createState();
-    start->transitions[c].push_back(accept);
+    State *start;
+    State *accept;
+};
+
+static Fragment singleCharNFA(StateArena &arena, char c)
+{
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    unsigned char b = static_cast<unsigned char>(c);
+    start->transitions.push_back({{b, b}, accept});
+    return {start, accept};
+}
+
+// One state pair for the whole set and one edge per run of consecutive
+// bytes, so [a-z] is a single edge.
+static Fragment byteSetNFA(StateArena &arena, const ByteSet &set)
+{
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    for (ByteRange range : byteRanges(set))
+        start->transitions.push_back({range, accept});
     return {start, accept};
 }
 
-NFA concat(NFA a, NFA b)
+namespace
+{
+    // The UTF-8 sequences of a codepoint set merged into an acyclic automaton:
+    // common prefixes are shared as in a trie and equal suffixes through a
+    // table of finished nodes, so the trailing continuation bytes are built
+    // once per length. Node 0 is the start and node 1 the accept.
+    struct Utf8Automaton
+    {
+        static constexpr uint32_t kOpen = UINT32_MAX; // edge into the next pending node
+        std::vector<std::vector<std::pair<ByteRange, uint32_t>>> edges; // node -> (range, node)
+
+        explicit Utf8Automaton(const CodepointSet &set) : edges(2)
+        {
+            // Nodes along the last sequence added; each but the deepest ends
+            // with an open edge into the next one.
+            std::vector<std::vector<std::pair<ByteRange, uint32_t>>> pending(1);
+            std::map<std::vector<uint32_t>, uint32_t> finished;
+            auto finish = [&]()
+            {
+                std::vector<uint32_t> key;
+                for (auto [range, target] : pending.back())
+                {
+                    key.push_back(range.lo << 8 | range.hi);
+                    key.push_back(target);
+                }
+                auto [it, inserted] = finished.try_emplace(std::move(key), static_cast<uint32_t>(edges.size()));
+                if (inserted)
+                    edges.push_back(std::move(pending.back()));
+                pending.pop_back();
+                pending.back().back().second = it->second;
+            };
+
+            for (const std::vector<ByteRange> &sequence : utf8Sequences(set))
+            {
+                size_t shared = 0;
+                while (shared + 1 < pending.size() && shared + 1 < sequence.size() &&
+                       pending[shared].back().first == sequence[shared])
+                    ++shared;
+                while (pending.size() > shared + 1)
+                    finish();
+                for (size_t i = shared; i < sequence.size(); ++i)
+                {
+                    bool last = i + 1 == sequence.size();
+                    pending.back().push_back({sequence[i], last ? 1u : kOpen});
+                    if (!last)
+                        pending.emplace_back();
+                }
+            }
+            while (pending.size() > 1)
+                finish();
+            edges[0] = std::move(pending[0]);
+        }
+    };
+}
+
+// The UTF-8 automaton of the set, one state per node.
+static Fragment utf8SetNFA(StateArena &arena, const CodepointSet &set)
+{
+    Utf8Automaton automaton(set);
+    std::vector<State *> states(automaton.edges.size());
+    for (State *&state : states)
+        state = arena.allocate();
+    for (size_t n = 0; n < states.size(); ++n)
+        for (auto [range, target] : automaton.edges[n])
+            states[n]->transitions.push_back({range, states[target]});
+    return {states[0], states[1]};
+}
+
+static Fragment concat(Fragment a, Fragment b)
 {
-    a.accept->transitions['\0'].push_back(b.start);
+    a.accept->epsilon.push_back(b.start);
     return {a.start, b.accept};
 }
 
-NFA alternate(NFA a, NFA b)
+static Fragment alternate(StateArena &arena, Fragment a, Fragment b)
+{
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    start->epsilon = {a.start, b.start};
+    a.accept->epsilon.push_back(accept);
+    b.accept->epsilon.push_back(accept);
+    return {start, accept};
+}
+
+static Fragment kleeneStar(StateArena &arena, Fragment a)
+{
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    start->epsilon = {a.start, accept};
+    a.accept->epsilon = {a.start, accept};
+    return {start, accept};
+}
+
+// Like the star, but the only way in is through a.
+static Fragment kleenePlus(StateArena &arena, Fragment a)
+{
+    State *accept = arena.allocate();
+    a.accept->epsilon = {a.start, accept};
+    return {a.start, accept};
+}
+
+static Fragment optional(StateArena &arena, Fragment a)
 {
-    State *start = createState();
-    State *accept = createState();
-    start->transitions['\0'] = {a.start, b.start};
-    a.accept->transitions['\0'].push_back(accept);
-    b.accept->transitions['\0'].push_back(accept);
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    start->epsilon = {a.start, accept};
+    a.accept->epsilon.push_back(accept);
     return {start, accept};
 }
 
-NFA kleeneStar(NFA a)
+static Fragment emptyNFA(StateArena &arena)
 {
-    State *start = createState();
-    State *accept = createState();
-    start->transitions['\0'] = {a.start, accept};
-    a.accept->transitions['\0'] = {a.start, accept};
+    State *start = arena.allocate();
+    State *accept = arena.allocate();
+    start->epsilon.push_back(accept);
     return {start, accept};
 }
 
-std::string addConcat(const std::string &regex)
+static void appendKeyByte(std::string &key, char c)
+{
+    if (!isalnum(static_cast<unsigned char>(c)))
+        key += '\\';
+    key += c;
+}
+
+// Postfix form of the AST with explicit '.' for concatenation. Operator bytes
+// used as literals are escaped and classes are printed as sorted ranges, so
+// regexes share a key only if they have the same tree.
+std::string canonicalRegex(const RegexAST &ast)
 {
-    std::string result;
-    for (size_t i = 0; i < regex.size(); ++i)
+    std::string key;
+    for (const RegexNode &node : ast.nodes)
     {
-        char c1 = regex[i];
-        result += c1;
-        if (i + 1 < regex.size())
+        switch (node.kind)
+        {
+        case RegexNode::Empty:
+            key += "()";
+            break;
+        case RegexNode::Literal:
+            appendKeyByte(key, node.byte);
+            break;
+        case RegexNode::Class:
+        {
+            const ByteSet &set = ast.sets[node.set];
+            key += '[';
+            for (int lo = 0; lo < 256; ++lo)
+            {
+                if (!set.test(lo))
+                    continue;
+                int hi = lo;
+                while (hi + 1 < 256 && set.test(hi + 1))
+                    ++hi;
+                appendKeyByte(key, static_cast<char>(lo));
+                if (hi > lo)
+                {
+                    key += '-';
+                    appendKeyByte(key, static_cast<char>(hi));
+                }
+                lo = hi;
+            }
+            key += ']';
+            break;
+        }
+        case RegexNode::Utf8Class:
         {
-            char c2 = regex[i + 1];
-            if ((isalnum(c1) || c1 == '*' || c1 == ')') &&
-                (isalnum(c2) || c2 == '('))
+            char hex[24];
+            key += '<';
+            for (auto [lo, hi] : ast.codepointSets[node.set])
             {
-                result += '.';
+                std::snprintf(hex, sizeof(hex), lo == hi ? "%x," : "%x-%x,", lo, hi);
+                key += hex;
             }
+            key += '>';
+            break;
+        }
+        case RegexNode::Concat:
+            key += '.';
+            break;
+        case RegexNode::Alternate:
+            key += '|';
+            break;
+        case RegexNode::Star:
+            key += '*';
+            break;
+        case RegexNode::Plus:
+            key += '+';
+            break;
+        case RegexNode::Question:
+            key += '?';
+            break;
+        case RegexNode::Repeat:
+            key += '{' + std::to_string(node.min) + ',' +
+                   (node.max == RegexNode::kUnbounded ? "" : std::to_string(node.max)) + '}';
+            break;
         }
     }
-    return result;
+    return key;
 }
 
-int precedence(char op)
+std::string canonicalRegex(const std::string &regex)
 {
-    switch (op)
-    {
-    case '*':
-        return 3;
-    case '.':
-        return 2;
-    case '|':
-        return 1;
-    default:
-        return 0;
-    }
+    return canonicalRegex(parseRegex(regex));
 }
 
-std::string toPostfix(const std::string &regex)
+namespace
 {
-    std::string postfix;
-    std::stack<char> ops;
-    for (char c : addConcat(regex))
+    // Operand copies a counted repetition is built from: one per iteration up
+    // to the upper bound, or up to the lower bound when the last copy loops.
+    uint32_t repeatCopies(const RegexNode &node)
     {
-        if (isalnum(c))
+        return node.max == RegexNode::kUnbounded ? node.min : node.max;
+    }
+
+    // Thompson construction as a forward pass over a node range. The first
+    // copy of a counted operand is the fragment the pass already built; the
+    // others rebuild the operand's range [first[child], child].
+    class ThompsonBuilder
+    {
+    public:
+        ThompsonBuilder(const RegexAST &ast, StateArena &arena)
+            : ast(ast), arena(arena), fragments(ast.nodes.size()), first(subtreeFirst(ast)) {}
+
+        Fragment build(uint32_t lo, uint32_t hi)
         {
-            postfix += c;
+            for (uint32_t i = lo; i <= hi; ++i)
+                fragments[i] = fragmentOf(ast.nodes[i]);
+            return fragments[hi];
         }
-        else if (c == '(')
+
+    private:
+        Fragment fragmentOf(const RegexNode &node)
         {
-            ops.push(c);
+            switch (node.kind)
+            {
+            case RegexNode::Empty:
+                return emptyNFA(arena);
+            case RegexNode::Literal:
+                return singleCharNFA(arena, node.byte);
+            case RegexNode::Class:
+                return byteSetNFA(arena, ast.sets[node.set]);
+            case RegexNode::Utf8Class:
+                return utf8SetNFA(arena, ast.codepointSets[node.set]);
+            case RegexNode::Concat:
+                return concat(fragments[node.left], fragments[node.right]);
+            case RegexNode::Alternate:
+                return alternate(arena, fragments[node.left], fragments[node.right]);
+            case RegexNode::Star:
+                return kleeneStar(arena, fragments[node.left]);
+            case RegexNode::Plus:
+                return kleenePlus(arena, fragments[node.left]);
+            case RegexNode::Question:
+                return optional(arena, fragments[node.left]);
+            case RegexNode::Repeat:
+                break;
+            }
+            return repeat(node);
         }
-        else if (c == ')')
+
+        // x{m,n} is m copies followed by the nested optionals (x(x(x)?)?)?:
+        // n copies rather than m + n, and once an optional copy fails no
+        // later copy stays live. x{m,} loops on its last copy.
+        Fragment repeat(const RegexNode &node)
         {
-            while (!ops.empty() && ops.top() != '(')
+            std::vector<Fragment> copies{fragments[node.left]};
+            while (copies.size() < repeatCopies(node))
+                copies.push_back(build(first[node.left], node.left));
+
+            size_t mandatory = copies.size();
+            if (node.max == RegexNode::kUnbounded)
+                copies.back() = kleenePlus(arena, copies.back());
+            else
+                mandatory = node.min;
+            if (mandatory < copies.size())
             {
-                postfix += ops.top();
-                ops.pop();
+                Fragment tail = optional(arena, copies.back());
+                for (size_t k = copies.size() - 1; k-- > mandatory;)
+                    tail = optional(arena, concat(copies[k], tail));
+                copies.resize(mandatory);
+                copies.push_back(tail);
             }
-            ops.pop(); // remove '('
+
+            Fragment result = copies[0];
+            for (size_t k = 1; k < copies.size(); ++k)
+                result = concat(result, copies[k]);
+            return result;
         }
-        else
+
+        const RegexAST &ast;
+        StateArena &arena;
+        std::vector<Fragment> fragments;
+        std::vector<uint32_t> first;
+    };
+
+    // First/last position sets and nullability of a subexpression.
+    struct GlushkovNode
+    {
+        std::vector<uint32_t> first, last;
+        bool nullable = false;
+    };
+
+    // Glushkov construction as a forward pass over a node range; counted
+    // operands are re-expanded the same way as in ThompsonBuilder, each copy
+    // with fresh positions. Concatenation and loops add the follow edges
+    // last(a) -> first(b).
+    class GlushkovBuilder
+    {
+    public:
+        GlushkovBuilder(const RegexAST &ast, GlushkovNFA &nfa)
+            : ast(ast), nfa(nfa), nodes(ast.nodes.size()), first(subtreeFirst(ast)) {}
+
+        GlushkovNode build(uint32_t lo, uint32_t hi)
         {
-            while (!ops.empty() && precedence(ops.top()) >= precedence(c))
+            for (uint32_t i = lo; i <= hi; ++i)
+                nodes[i] = nodeOf(ast.nodes[i]);
+            return std::move(nodes[hi]);
+        }
+
+    private:
+        // Every node has exactly one parent, so children are moved from.
+        GlushkovNode nodeOf(const RegexNode &node)
+        {
+            GlushkovNode r;
+            switch (node.kind)
+            {
+            case RegexNode::Empty:
+                r.nullable = true;
+                break;
+            case RegexNode::Literal:
+            case RegexNode::Class:
             {
-                postfix += ops.top();
-                ops.pop();
+                uint32_t p = position(node.kind == RegexNode::Literal
+                                          ? ByteSet().set(static_cast<unsigned char>(node.byte))
+                                          : ast.sets[node.set]);
+                r = {{p}, {p}, false};
+                break;
             }
-            ops.push(c);
+            case RegexNode::Utf8Class:
+                r = utf8Set(ast.codepointSets[node.set]);
+                break;
+            case RegexNode::Concat:
+                r = concat(std::move(nodes[node.left]), std::move(nodes[node.right]));
+                break;
+            case RegexNode::Alternate:
+            {
+                GlushkovNode a = std::move(nodes[node.left]);
+                GlushkovNode b = std::move(nodes[node.right]);
+                r.first = merge(std::move(a.first), b.first);
+                r.last = merge(std::move(a.last), b.last);
+                r.nullable = a.nullable || b.nullable;
+                break;
+            }
+            case RegexNode::Star:
+            case RegexNode::Plus:
+                r = loop(std::move(nodes[node.left]));
+                r.nullable = r.nullable || node.kind == RegexNode::Star;
+                break;
+            case RegexNode::Question:
+                r = std::move(nodes[node.left]);
+                r.nullable = true;
+                break;
+            case RegexNode::Repeat:
+                r = repeat(node);
+                break;
+            }
+            return r;
         }
+
+        uint32_t position(const ByteSet &symbol)
+        {
+            nfa.symbol.push_back(symbol);
+            nfa.follow.emplace_back();
+            return static_cast<uint32_t>(nfa.symbol.size() - 1);
+        }
+
+        // One position per edge of the automaton utf8SetNFA builds; a
+        // position is followed by the edges leaving the node it enters.
+        GlushkovNode utf8Set(const CodepointSet &set)
+        {
+            Utf8Automaton automaton(set);
+            std::vector<std::vector<uint32_t>> out(automaton.edges.size()); // node -> positions of its edges
+            std::vector<std::pair<uint32_t, uint32_t>> entered;             // (position, node it enters)
+            for (size_t n = 0; n < automaton.edges.size(); ++n)
+            {
+                for (auto [range, target] : automaton.edges[n])
+                {
+                    ByteSet bytes;
+                    for (int b = range.lo; b <= range.hi; ++b)
+                        bytes.set(b);
+                    uint32_t p = position(bytes);
+                    out[n].push_back(p);
+                    entered.push_back({p, target});
+                }
+            }
+
+            GlushkovNode r;
+            r.first = out[0];
+            for (auto [p, node] : entered)
+            {
+                nfa.follow[p] = out[node];
+                if (node == 1)
+                    r.last.push_back(p);
+            }
+            return r;
+        }
+
+        // Same shape as ThompsonBuilder::repeat.
+        GlushkovNode repeat(const RegexNode &node)
+        {
+            std::vector<GlushkovNode> copies;
+            copies.push_back(std::move(nodes[node.left]));
+            while (copies.size() < repeatCopies(node))
+                copies.push_back(build(first[node.left], node.left));
+
+            size_t mandatory = copies.size();
+            if (node.max == RegexNode::kUnbounded)
+                copies.back() = loop(std::move(copies.back()));
+            else
+                mandatory = node.min;
+            if (mandatory < copies.size())
+            {
+                GlushkovNode tail = std::move(copies.back());
+                tail.nullable = true;
+                for (size_t k = copies.size() - 1; k-- > mandatory;)
+                {
+                    tail = concat(std::move(copies[k]), std::move(tail));
+                    tail.nullable = true;
+                }
+                copies.resize(mandatory);
+                copies.push_back(std::move(tail));
+            }
+
+            GlushkovNode result = std::move(copies[0]);
+            for (size_t k = 1; k < copies.size(); ++k)
+                result = concat(std::move(result), std::move(copies[k]));
+            return result;
+        }
+
+        GlushkovNode concat(GlushkovNode a, GlushkovNode b)
+        {
+            link(a.last, b.first);
+            GlushkovNode r;
+            r.first = a.nullable ? merge(a.first, b.first) : a.first;
+            r.last = b.nullable ? merge(b.last, a.last) : b.last;
+            r.nullable = a.nullable && b.nullable;
+            return r;
+        }
+
+        GlushkovNode loop(GlushkovNode a)
+        {
+            link(a.last, a.first);
+            return a;
+        }
+
+        void link(const std::vector<uint32_t> &from, const std::vector<uint32_t> &to)
+        {
+            for (uint32_t p : from)
+                nfa.follow[p].insert(nfa.follow[p].end(), to.begin(), to.end());
+        }
+
+        static std::vector<uint32_t> merge(std::vector<uint32_t> a, const std::vector<uint32_t> &b)
+        {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }
+
+        const RegexAST &ast;
+        GlushkovNFA &nfa;
+        std::vector<GlushkovNode> nodes;
+        std::vector<uint32_t> first;
+    };
+}
+
+NFA regexToNFA(const RegexAST &ast)
+{
+    NFA nfa;
+    nfa.arena = std::make_unique<StateArena>();
+    Fragment root = ThompsonBuilder(ast, *nfa.arena).build(0, ast.root());
+    nfa.start = root.start;
+    nfa.accept = root.accept;
+    return nfa;
+}
+
+NFA regexToNFA(const std::string &regex)
+{
+    return regexToNFA(parseRegex(regex));
+}
+
+GlushkovNFA regexToGlushkov(const RegexAST &ast)
+{
+    GlushkovNFA nfa;
+    nfa.symbol.emplace_back();
+    nfa.follow.emplace_back();
+    GlushkovNode root = GlushkovBuilder(ast, nfa).build(0, ast.root());
+
+    nfa.follow[0] = root.first;
+    nfa.finals = root.last;
+    if (root.nullable)
+        nfa.finals.push_back(0);
+    for (auto &targets : nfa.follow)
+    {
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
     }
-    while (!ops.empty())
+    std::sort(nfa.finals.begin(), nfa.finals.end());
+    return nfa;
+}
+
+GlushkovNFA regexToGlushkov(const std::string &regex)
+{
+    return regexToGlushkov(parseRegex(regex));
+}
+
+namespace
+{
+    // What is known about every string of a subexpression's language.
+    struct LiteralInfo
     {
-        postfix += ops.top();
-        ops.pop();
+        bool isExact = false; // the language is the single string `exact`
+        std::string exact;
+        std::string prefix; // every match starts with it
+        std::string suffix; // every match ends with it
+        std::string factor; // every match contains it
+    };
+
+    const std::string &longer(const std::string &a, const std::string &b)
+    {
+        return b.size() > a.size() ? b : a;
+    }
+
+    std::string commonSubstring(const std::string &a, const std::string &b)
+    {
+        size_t bestEnd = 0, bestLength = 0;
+        std::vector<size_t> prev(b.size() + 1, 0), curr(b.size() + 1, 0);
+        for (size_t i = 1; i <= a.size(); ++i)
+        {
+            for (size_t j = 1; j <= b.size(); ++j)
+            {
+                curr[j] = a[i - 1] == b[j - 1] ? prev[j - 1] + 1 : 0;
+                if (curr[j] > bestLength)
+                {
+                    bestLength = curr[j];
+                    bestEnd = i;
+                }
+            }
+            std::swap(prev, curr);
+        }
+        return a.substr(bestEnd - bestLength, bestLength);
+    }
+
+    // Concatenation joins the suffix of the left side with the prefix of the
+    // right side.
+    LiteralInfo concatInfo(const LiteralInfo &a, const LiteralInfo &b)
+    {
+        LiteralInfo r;
+        r.isExact = a.isExact && b.isExact;
+        r.exact = a.exact + b.exact;
+        r.prefix = a.isExact ? a.exact + b.prefix : a.prefix;
+        r.suffix = b.isExact ? a.suffix + b.exact : b.suffix;
+        r.factor = longer(longer(a.factor, b.factor), a.suffix + b.prefix);
+        return r;
+    }
+
+    // Alternation keeps only what both branches share.
+    LiteralInfo alternateInfo(const LiteralInfo &a, const LiteralInfo &b)
+    {
+        LiteralInfo r;
+        r.isExact = a.isExact && b.isExact && a.exact == b.exact;
+        r.exact = r.isExact ? a.exact : "";
+        size_t p = 0;
+        while (p < a.prefix.size() && p < b.prefix.size() && a.prefix[p] == b.prefix[p])
+            ++p;
+        r.prefix = a.prefix.substr(0, p);
+        size_t q = 0;
+        while (q < a.suffix.size() && q < b.suffix.size() &&
+               a.suffix[a.suffix.size() - 1 - q] == b.suffix[b.suffix.size() - 1 - q])
+            ++q;
+        r.suffix = a.suffix.substr(a.suffix.size() - q);
+        r.factor = longer(longer(r.prefix, r.suffix), commonSubstring(a.factor, b.factor));
+        return r;
     }
-    return postfix;
 }
 
-NFA regexToNFA(const std::string &regex)
+// Folds the AST bottom-up. Star and '?' may match the empty string and lose
+// everything, while '+' keeps all but exactness. x{m,n} contains m copies
+// of x in a row; at most four are spelled out, which keeps the literal
+// short and still required.
+std::string requiredLiteral(const RegexAST &ast)
 {
-    stateId = 0; // OK Reset state IDs for each run
+    constexpr uint32_t kMaxLiteralCopies = 4;
+    std::vector<LiteralInfo> infos(ast.nodes.size());
+    for (size_t i = 0; i < ast.nodes.size(); ++i)
+    {
+        const RegexNode &node = ast.nodes[i];
+        LiteralInfo &r = infos[i];
+        if (node.kind == RegexNode::Empty)
+        {
+            r.isExact = true;
+        }
+        else if (node.kind == RegexNode::Literal)
+        {
+            std::string s(1, node.byte);
+            r = {true, s, s, s, s};
+        }
+        else if (node.kind == RegexNode::Plus)
+        {
+            r = std::move(infos[node.left]);
+            r.isExact = false;
+            r.exact.clear();
+        }
+        else if (node.kind == RegexNode::Repeat && node.min > 0)
+        {
+            const LiteralInfo &x = infos[node.left];
+            uint32_t copies = std::min(node.min, kMaxLiteralCopies);
+            r = x;
+            for (uint32_t k = 1; k < copies; ++k)
+                r = concatInfo(r, x);
+            if (copies != node.max)
+                r = concatInfo(r, LiteralInfo()); // whatever follows is unknown
+        }
+        else if (node.kind == RegexNode::Concat)
+        {
+            r = concatInfo(infos[node.left], infos[node.right]);
+        }
+        else if (node.kind == RegexNode::Alternate)
+        {
+            r = alternateInfo(infos[node.left], infos[node.right]);
+        }
+        // Class, Utf8Class, Star, Question, Repeat{0,n}: nothing is known, r stays empty.
+    }
+    return infos[ast.root()].factor;
+}
+
+std::string requiredLiteral(const std::string &regex)
+{
+    return requiredLiteral(parseRegex(regex));
+}
+
+namespace
+{
+    uint64_t saturatingAdd(uint64_t a, uint64_t b)
+    {
+        return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+    }
+
+    uint64_t saturatingMul(uint64_t a, uint64_t b)
+    {
+        return b && a > UINT64_MAX / b ? UINT64_MAX : a * b;
+    }
+}
+
+// Mirrors the state and position counts of ThompsonBuilder and
+// GlushkovBuilder node by node. Every DFA state other than the start and
+// the dead state is the closure of the targets of one set of symbol edges,
+// and there is one such target per position.
+RegexSize estimateRegexSize(const RegexAST &ast)
+{
+    std::vector<RegexSize> sizes(ast.nodes.size());
+    for (size_t i = 0; i < ast.nodes.size(); ++i)
+    {
+        const RegexNode &node = ast.nodes[i];
+        RegexSize &r = sizes[i];
+        const RegexSize a = node.left != RegexNode::kNone ? sizes[node.left] : RegexSize();
+        const RegexSize b = node.right != RegexNode::kNone ? sizes[node.right] : RegexSize();
+        switch (node.kind)
+        {
+        case RegexNode::Empty:
+            r.nfaStates = 2;
+            break;
+        case RegexNode::Literal:
+        case RegexNode::Class:
+            r.nfaStates = 2;
+            r.positions = 1;
+            break;
+        case RegexNode::Utf8Class:
+        {
+            Utf8Automaton automaton(ast.codepointSets[node.set]);
+            r.nfaStates = automaton.edges.size();
+            for (const auto &edges : automaton.edges)
+                r.positions += edges.size();
+            break;
+        }
+        case RegexNode::Concat:
+            r.nfaStates = saturatingAdd(a.nfaStates, b.nfaStates);
+            r.positions = saturatingAdd(a.positions, b.positions);
+            break;
+        case RegexNode::Alternate:
+            r.nfaStates = saturatingAdd(saturatingAdd(a.nfaStates, b.nfaStates), 2);
+            r.positions = saturatingAdd(a.positions, b.positions);
+            break;
+        case RegexNode::Star:
+        case RegexNode::Question:
+            r.nfaStates = saturatingAdd(a.nfaStates, 2);
+            r.positions = a.positions;
+            break;
+        case RegexNode::Plus:
+            r.nfaStates = saturatingAdd(a.nfaStates, 1);
+            r.positions = a.positions;
+            break;
+        case RegexNode::Repeat:
+        {
+            uint64_t copies = repeatCopies(node);
+            uint64_t extra = node.max == RegexNode::kUnbounded ? 1 : 2 * uint64_t(node.max - node.min);
+            r.nfaStates = saturatingAdd(saturatingMul(a.nfaStates, copies), extra);
+            r.positions = saturatingMul(a.positions, copies);
+            break;
+        }
+        }
+    }
+    RegexSize size = sizes[ast.root()];
+    size.dfaStatesBound = size.positions >= 62 ? UINT64_MAX : (uint64_t(1) << size.positions) + 2;
+    size.dfaBytesBound = saturatingMul(size.dfaStatesBound, saturatingAdd(size.nfaStates, 63) / 64 * sizeof(uint64_t));
+    return size;
+}
+
+// Lays out the edges of states (indexed by id) as CSR arrays.
+static FlatNFA flattenStates(const std::vector<State *> &states, int startId, int acceptId)
+{
+    FlatNFA flat;
+    flat.numStates = static_cast<uint32_t>(states.size());
+    flat.start = static_cast<uint32_t>(startId);
+    flat.accept = static_cast<uint32_t>(acceptId);
+    flat.epsOffsets.reserve(states.size() + 1);
+    flat.symOffsets.reserve(states.size() + 1);
+
+    for (State *s : states)
+    {
+        flat.epsOffsets.push_back(static_cast<uint32_t>(flat.epsTargets.size()));
+        flat.symOffsets.push_back(static_cast<uint32_t>(flat.symTargets.size()));
+        if (!s)
+            continue;
+        for (State *next : s->epsilon)
+            flat.epsTargets.push_back(static_cast<uint32_t>(next->id));
+        for (auto &[range, next] : s->transitions)
+        {
+            flat.symRanges.push_back(range);
+            flat.symTargets.push_back(static_cast<uint32_t>(next->id));
+        }
+    }
+    flat.epsOffsets.push_back(static_cast<uint32_t>(flat.epsTargets.size()));
+    flat.symOffsets.push_back(static_cast<uint32_t>(flat.symTargets.size()));
+    return flat;
+}
+
+FlatNFA flattenNFA(const NFA &nfa)
+{
+    std::vector<State *> states(nfa.stateCount());
+    for (size_t i = 0; i < states.size(); ++i)
+        states[i] = nfa.arena->at(static_cast<int>(i));
+    return flattenStates(states, nfa.start->id, nfa.accept->id);
+}
+
+FlatNFA flattenNFA(State *start, int acceptId)
+{
+    std::vector<State *> states;
+    std::stack<State *> stack;
+    stack.push(start);
+    while (!stack.empty())
+    {
+        State *curr = stack.top();
+        stack.pop();
+        if (curr->id >= (int)states.size())
+            states.resize(curr->id + 1, nullptr);
+        if (states[curr->id])
+            continue;
+        states[curr->id] = curr;
+        for (State *next : curr->epsilon)
+            stack.push(next);
+        for (auto &[range, next] : curr->transitions)
+            stack.push(next);
+    }
+    if (acceptId >= (int)states.size())
+        states.resize(acceptId + 1, nullptr);
+    return flattenStates(states, start->id, acceptId);
+}
+
+// Counting sort of the edges by target, so the CSR layout is rebuilt with the
+// same per-state edge order as a forward walk would produce.
+FlatNFA reverseNFA(const FlatNFA &nfa)
+{
+    const uint32_t n = nfa.numStates;
+    FlatNFA rev;
+    rev.numStates = n;
+    rev.start = nfa.accept;
+    rev.accept = nfa.start;
+    rev.epsOffsets.assign(n + 1, 0);
+    rev.symOffsets.assign(n + 1, 0);
+    rev.epsTargets.resize(nfa.epsTargets.size());
+    rev.symRanges.resize(nfa.symRanges.size());
+    rev.symTargets.resize(nfa.symTargets.size());
+
+    for (uint32_t t : nfa.epsTargets)
+        rev.epsOffsets[t + 1]++;
+    for (uint32_t t : nfa.symTargets)
+        rev.symOffsets[t + 1]++;
+    for (uint32_t s = 0; s < n; ++s)
+    {
+        rev.epsOffsets[s + 1] += rev.epsOffsets[s];
+        rev.symOffsets[s + 1] += rev.symOffsets[s];
+    }
+
+    std::vector<uint32_t> epsFill(rev.epsOffsets.begin(), rev.epsOffsets.end() - 1);
+    std::vector<uint32_t> symFill(rev.symOffsets.begin(), rev.symOffsets.end() - 1);
+    for (uint32_t s = 0; s < n; ++s)
+    {
+        for (uint32_t e = nfa.epsOffsets[s]; e < nfa.epsOffsets[s + 1]; ++e)
+            rev.epsTargets[epsFill[nfa.epsTargets[e]]++] = s;
+        for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
+        {
+            uint32_t slot = symFill[nfa.symTargets[e]]++;
+            rev.symRanges[slot] = nfa.symRanges[e];
+            rev.symTargets[slot] = s;
+        }
+    }
+    return rev;
+}
+
+// The NFAs are laid out back to back with their state ids shifted, followed by
+// one new start state.
+FlatNFA unionNFAs(const std::vector<FlatNFA> &nfas)
+{
+    FlatNFA all;
+    std::vector<uint32_t> starts;
+    all.epsOffsets.push_back(0);
+    all.symOffsets.push_back(0);
+    uint32_t base = 0;
+    for (const FlatNFA &nfa : nfas)
+    {
+        for (uint32_t s = 0; s < nfa.numStates; ++s)
+        {
+            for (uint32_t e = nfa.epsOffsets[s]; e < nfa.epsOffsets[s + 1]; ++e)
+                all.epsTargets.push_back(base + nfa.epsTargets[e]);
+            for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
+            {
+                all.symRanges.push_back(nfa.symRanges[e]);
+                all.symTargets.push_back(base + nfa.symTargets[e]);
+            }
+            all.epsOffsets.push_back(static_cast<uint32_t>(all.epsTargets.size()));
+            all.symOffsets.push_back(static_cast<uint32_t>(all.symTargets.size()));
+        }
+        starts.push_back(base + nfa.start);
+        all.accepts.push_back(base + nfa.accept);
+        base += nfa.numStates;
+    }
+
+    all.start = base;
+    all.epsTargets.insert(all.epsTargets.end(), starts.begin(), starts.end());
+    all.epsOffsets.push_back(static_cast<uint32_t>(all.epsTargets.size()));
+    all.symOffsets.push_back(static_cast<uint32_t>(all.symTargets.size()));
+    all.numStates = base + 1;
+    if (nfas.empty())
+    {
+        // An empty set matches nothing: give it an unreachable accept state.
+        all.accepts.push_back(all.numStates++);
+        all.epsOffsets.push_back(all.epsOffsets.back());
+        all.symOffsets.push_back(all.symOffsets.back());
+    }
+    all.accept = all.accepts[0];
+    return all;
+}
+
+// Iterative Tarjan over the ε-edges. Components are completed in reverse
+// topological order, so every ε-successor component already has its closure
+// when a component is finished.
+EpsilonClosures computeEpsilonClosures(const FlatNFA &nfa, size_t maxBytes)
+{
+    const uint32_t n = nfa.numStates;
+    const uint32_t unvisited = UINT32_MAX;
+
+    EpsilonClosures result;
+    result.component.assign(n, unvisited);
+    std::vector<uint32_t> index(n, unvisited), low(n, 0);
+    std::vector<uint32_t> sccStack, members;
+    std::vector<uint32_t> stamp(n, unvisited); // state -> last component that listed it
+    std::vector<std::pair<uint32_t, uint32_t>> callStack; // (state, next ε-edge)
+    uint32_t counter = 0;
 
-    std::stack<NFA> stack;
-    std::string postfix = toPostfix(regex);
-    for (char c : postfix)
+    auto visit = [&](uint32_t s)
     {
-        if (isalnum(c))
+        index[s] = low[s] = counter++;
+        sccStack.push_back(s);
+        callStack.push_back({s, nfa.epsOffsets[s]});
+    };
+
+    for (uint32_t root = 0; root < n; ++root)
+    {
+        if (index[root] != unvisited)
+            continue;
+        visit(root);
+        while (!callStack.empty())
         {
-            stack.push(singleCharNFA(c));
+            uint32_t v = callStack.back().first;
+            uint32_t &edge = callStack.back().second;
+            if (edge < nfa.epsOffsets[v + 1])
+            {
+                uint32_t w = nfa.epsTargets[edge++];
+                if (index[w] == unvisited)
+                    visit(w);
+                else if (result.component[w] == unvisited)
+                    low[v] = std::min(low[v], index[w]);
+                continue;
+            }
+
+            if (low[v] == index[v])
+            {
+                uint32_t c = static_cast<uint32_t>(result.components());
+                size_t begin = result.states.size();
+                auto add = [&](uint32_t s)
+                {
+                    if (stamp[s] != c)
+                    {
+                        stamp[s] = c;
+                        result.states.push_back(s);
+                    }
+                };
+                members.clear();
+                uint32_t w;
+                do
+                {
+                    w = sccStack.back();
+                    sccStack.pop_back();
+                    result.component[w] = c;
+                    add(w);
+                    members.push_back(w);
+                } while (w != v);
+
+                // Successor components are already finished, so their lists
+                // are complete.
+                for (uint32_t m : members)
+                {
+                    for (uint32_t e = nfa.epsOffsets[m]; e < nfa.epsOffsets[m + 1]; ++e)
+                    {
+                        uint32_t next = result.component[nfa.epsTargets[e]];
+                        if (next != c)
+                            for (uint32_t i = result.offsets[next]; i < result.offsets[next + 1]; ++i)
+                                add(result.states[i]);
+                    }
+                }
+                std::sort(result.states.begin() + begin, result.states.end());
+                result.offsets.push_back(static_cast<uint32_t>(result.states.size()));
+                if (maxBytes && result.bytes() > maxBytes)
+                {
+                    result.truncated = true;
+                    return result;
+                }
+            }
+
+            callStack.pop_back();
+            if (!callStack.empty())
+            {
+                uint32_t parent = callStack.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
         }
-        else if (c == '*')
+    }
+    return result;
+}
+
+// Splits every class that `bytes` cuts into its members inside and outside.
+static void refineByteClasses(ByteClasses &classes, const ByteSet &bytes)
+{
+    std::array<int, 256> inside{}, total{}, splitTo;
+    splitTo.fill(-1);
+    for (int b = 0; b < 256; ++b)
+    {
+        total[classes.classOf[b]]++;
+        if (bytes.test(b))
+            inside[classes.classOf[b]]++;
+    }
+    for (int b = 0; b < 256; ++b)
+    {
+        int cls = classes.classOf[b];
+        if (!bytes.test(b) || inside[cls] == total[cls])
+            continue;
+        if (splitTo[cls] == -1)
+            splitTo[cls] = classes.count++;
+        classes.classOf[b] = static_cast<uint8_t>(splitTo[cls]);
+    }
+}
+
+// Bytes leading from one state to the same targets are never told apart, so
+// the partition is refined by the label set of each (state, target) pair: a
+// class such as [a-z] stays one byte class.
+ByteClasses computeByteClasses(const FlatNFA &nfa)
+{
+    ByteClasses classes;
+    classes.classOf.fill(0);
+    classes.count = 1;
+
+    std::unordered_set<ByteSet> seen;
+    std::unordered_map<uint32_t, ByteSet> byTarget;
+    for (uint32_t s = 0; s < nfa.numStates; ++s)
+    {
+        byTarget.clear();
+        for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
         {
-            NFA a = stack.top();
-            stack.pop();
-            stack.push(kleeneStar(a));
+            ByteSet &bytes = byTarget[nfa.symTargets[e]];
+            for (int b = nfa.symRanges[e].lo; b <= nfa.symRanges[e].hi; ++b)
+                bytes.set(b);
         }
-        else if (c == '.')
+        for (const auto &[target, bytes] : byTarget)
+            if (seen.insert(bytes).second)
+                refineByteClasses(classes, bytes);
+    }
+
+    // Renumber in byte order so class 0 is the class of byte 0.
+    std::array<int, 256> renumber;
+    renumber.fill(-1);
+    int next = 0;
+    for (int b = 0; b < 256; ++b)
+    {
+        int &id = renumber[classes.classOf[b]];
+        if (id == -1)
+            id = next++;
+        classes.classOf[b] = static_cast<uint8_t>(id);
+    }
+    return classes;
+}
+
+std::vector<std::pair<int, int>> classSpans(const ByteClasses &classes, const std::vector<ByteRange> &ranges)
+{
+    // seen[b] = classes whose smallest byte is below b.
+    std::array<int, 257> seen;
+    seen[0] = 0;
+    for (int b = 0; b < 256; ++b)
+        seen[b + 1] = std::max(seen[b], classes.classOf[b] + 1);
+
+    std::vector<std::pair<int, int>> spans;
+    spans.reserve(ranges.size());
+    for (ByteRange range : ranges)
+        spans.push_back({seen[range.lo], seen[range.hi + 1]});
+    return spans;
+}
+
+std::vector<ByteRange> byteRanges(const ByteSet &set)
+{
+    std::vector<ByteRange> ranges;
+    for (int b = 0; b < 256; ++b)
+    {
+        if (!set.test(b))
+            continue;
+        int lo = b;
+        while (b + 1 < 256 && set.test(b + 1))
+            ++b;
+        ranges.push_back({static_cast<unsigned char>(lo), static_cast<unsigned char>(b)});
+    }
+    return ranges;
+}
+
+// Splits each range until all its values have encodings of one length whose
+// continuation bytes each run over a full range, so that the encodings form
+// the cross product of per-byte ranges. Lower halves are taken first, which
+// keeps the sequences in ascending order.
+std::vector<std::vector<ByteRange>> utf8Sequences(const CodepointSet &set)
+{
+    std::vector<std::vector<ByteRange>> sequences;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    for (auto it = set.rbegin(); it != set.rend(); ++it)
+    {
+        // Surrogates have no encoding.
+        if (it->second > 0xDFFF)
+            stack.push_back({std::max(it->first, 0xE000u), std::min(it->second, 0x10FFFFu)});
+        if (it->first < 0xD800)
+            stack.push_back({it->first, std::min(it->second, 0xD7FFu)});
+    }
+
+    while (!stack.empty())
+    {
+        auto [lo, hi] = stack.back();
+        stack.pop_back();
+        if (lo > hi)
+            continue;
+
+        bool split = false;
+        for (uint32_t max : {0x7Fu, 0x7FFu, 0xFFFFu})
         {
-            NFA b = stack.top();
-            stack.pop();
-            NFA a = stack.top();
-            stack.pop();
-            stack.push(concat(a, b));
+            if (lo <= max && max < hi)
+            {
+                stack.push_back({max + 1, hi});
+                stack.push_back({lo, max});
+                split = true;
+                break;
+            }
         }
-        else if (c == '|')
+        int length = lo < 0x80 ? 1 : lo < 0x800 ? 2 : lo < 0x10000 ? 3 : 4;
+        for (int i = 1; i < length && !split; ++i)
         {
-            NFA b = stack.top();
-            stack.pop();
-            NFA a = stack.top();
-            stack.pop();
-            stack.push(alternate(a, b));
+            uint32_t mask = (1u << (6 * i)) - 1;
+            if ((lo & ~mask) == (hi & ~mask))
+                continue;
+            if ((lo & mask) != 0)
+            {
+                stack.push_back({(lo | mask) + 1, hi});
+                stack.push_back({lo, lo | mask});
+                split = true;
+            }
+            else if ((hi & mask) != mask)
+            {
+                stack.push_back({hi & ~mask, hi});
+                stack.push_back({lo, (hi & ~mask) - 1});
+                split = true;
+            }
         }
+        if (split)
+            continue;
+
+        std::string from = utf8Encode(lo), to = utf8Encode(hi);
+        std::vector<ByteRange> sequence;
+        for (size_t i = 0; i < from.size(); ++i)
+            sequence.push_back({static_cast<unsigned char>(from[i]), static_cast<unsigned char>(to[i])});
+        sequences.push_back(std::move(sequence));
     }
-    return stack.top();
+    return sequences;
+}
+
+std::string byteLabel(char c)
+{
+    unsigned char b = static_cast<unsigned char>(c);
+    if (b > 0x20 && b < 0x7f)
+        return std::string(1, c);
+    char hex[8];
+    std::snprintf(hex, sizeof(hex), "\\x%02x", b);
+    return hex;
 }
 
-void printNFA(State *start)
+std::string rangeLabel(ByteRange range)
+{
+    std::string label = byteLabel(static_cast<char>(range.lo));
+    if (range.hi != range.lo)
+        label += "-" + byteLabel(static_cast<char>(range.hi));
+    return label;
+}
+
+void printNFA(const NFA &nfa)
 {
     std::set<int> visited;
     std::stack<State *> stack;
-    stack.push(start);
+    stack.push(nfa.start);
     while (!stack.empty())
     {
         State *curr = stack.top();
@@ -171,15 +1205,15 @@ void printNFA(State *start)
         if (visited.count(curr->id))
             continue;
         visited.insert(curr->id);
-        for (auto &[c, nextStates] : curr->transitions)
+        for (State *next : curr->epsilon)
         {
-            for (State *next : nextStates)
-            {
-                std::cout << "State " << curr->id << " --"
-                          << (c == '\0' ? "eps" : std::string(1, c))
-                          << "--> State " << next->id << "\n";
-                stack.push(next);
-            }
+            std::cout << "State " << curr->id << " --eps--> State " << next->id << "\n";
+            stack.push(next);
+        }
+        for (auto &[range, next] : curr->transitions)
+        {
+            std::cout << "State " << curr->id << " --" << rangeLabel(range) << "--> State " << next->id << "\n";
+            stack.push(next);
         }
     }
 }
@@ -187,7 +1221,7 @@ void printNFA(State *start)
 #include <nlohmann/json.hpp> // use https://github.com/nlohmann/json
 using json = nlohmann::json;
 
-json exportToJson(State *start)
+json exportToJson(const NFA &nfa)
 {
     std::set<int> visited;
     std::stack<State *> stack;
@@ -195,7 +1229,7 @@ json exportToJson(State *start)
     j["states"] = json::array();
     j["transitions"] = json::array();
 
-    stack.push(start);
+    stack.push(nfa.start);
     while (!stack.empty())
     {
         State *curr = stack.top();
@@ -205,18 +1239,20 @@ json exportToJson(State *start)
         visited.insert(curr->id);
         j["states"].push_back(curr->id);
 
-        for (auto &[c, nextStates] : curr->transitions)
+        for (State *next : curr->epsilon)
         {
-            for (State *next : nextStates)
-            {
-                j["transitions"].push_back({{"from", curr->id},
-                                            {"to", next->id},
-                                            {"symbol", c == '\0' ? "eps" : std::string(1, c)}});
-                stack.push(next);
-            }
+            j["transitions"].push_back({{"from", curr->id}, {"to", next->id}, {"symbol", "eps"}});
+            stack.push(next);
+        }
+        for (auto &[range, next] : curr->transitions)
+        {
+            j["transitions"].push_back({{"from", curr->id},
+                                        {"to", next->id},
+                                        {"symbol", rangeLabel(range)}});
+            stack.push(next);
         }
     }
-    j["start"] = start->id;
-    j["accept"] = stateId - 1; // last created state = accept
+    j["start"] = nfa.start->id;
+    j["accept"] = nfa.accept->id;
     return j;
 }
@@ -0,0 +1,131 @@
+#include "pattern_cache.h"
+#include <utility>
+
+static size_t estimateDenseBytes(const DenseDFA &dense)
+{
+    return sizeof(DenseDFA) + dense.table.size() * sizeof(uint32_t) +
+           dense.acceptBits.size() * sizeof(uint64_t) + dense.stateIds.size() * sizeof(int) +
+           dense.acceptSetOf.size() * sizeof(uint32_t);
+}
+
+static size_t estimateFlatBytes(const FlatNFA &flat)
+{
+    return sizeof(FlatNFA) +
+           (flat.epsOffsets.size() + flat.epsTargets.size() + flat.symOffsets.size() + flat.symTargets.size()) * sizeof(uint32_t) +
+           flat.symRanges.size() * sizeof(ByteRange);
+}
+
+std::shared_ptr<const CompiledPattern> compilePattern(const RegexAST &ast, const DFABuildOptions &options)
+{
+    // Counted repetition can make the NFA and its ε-closures alone too large;
+    // reject it unbuilt.
+    size_t nfaBytes = estimateRegexSize(ast).nfaBytes();
+    if (options.maxBytes && nfaBytes > options.maxBytes)
+        throw DFABuildError(DFABuildError::MaxBytes, 0, nfaBytes, options);
+
+    auto compiled = std::make_shared<CompiledPattern>();
+    compiled->key = canonicalRegex(ast);
+    compiled->nfa = regexToNFA(ast);
+    compiled->flat = flattenNFA(compiled->nfa);
+    compiled->dfa = convertNFAtoDFA(compiled->flat, options);
+    compiled->minDFA = minimizeDFA(compiled->dfa);
+    compiled->dense = compileDFA(compiled->dfa);
+    compiled->denseMin = compileDFA(compiled->minDFA);
+    compiled->literal = requiredLiteral(ast);
+    compiled->nfaBytes = nfaBytes;
+    compiled->dfaBytes = compiled->dfa.buildBytes;
+
+    compiled->bytes = sizeof(CompiledPattern) + compiled->key.size() + compiled->literal.size() +
+                      compiled->nfa.arenaBytes() + estimateFlatBytes(compiled->flat) +
+                      estimateDFABytes(compiled->dfa) + estimateDFABytes(compiled->minDFA) +
+                      estimateDenseBytes(compiled->dense) + estimateDenseBytes(compiled->denseMin);
+    return compiled;
+}
+
+std::shared_ptr<const CompiledPattern> compilePattern(const std::string &regex, const DFABuildOptions &options)
+{
+    return compilePattern(parseRegex(regex), options);
+}
+
+// The checks compilePattern makes, against the figures of the original build,
+// so a hit fails exactly when a fresh build would.
+static void checkLimits(const CompiledPattern &pattern, const DFABuildOptions &limits)
+{
+    if (limits.maxBytes && pattern.nfaBytes > limits.maxBytes)
+        throw DFABuildError(DFABuildError::MaxBytes, 0, pattern.nfaBytes, limits);
+    size_t states = pattern.dfa.states.size();
+    if (limits.maxStates && states > limits.maxStates)
+        throw DFABuildError(DFABuildError::MaxStates, states, pattern.dfaBytes, limits);
+    if (limits.maxBytes && pattern.dfaBytes > limits.maxBytes)
+        throw DFABuildError(DFABuildError::MaxBytes, states, pattern.dfaBytes, limits);
+}
+
+std::shared_ptr<const CompiledPattern> PatternCache::get(const std::string &regex, const DFABuildOptions &limits)
+{
+    RegexAST ast = parseRegex(regex);
+    std::string key = canonicalRegex(ast);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            counters.hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            checkLimits(**it->second, limits);
+            return *it->second;
+        }
+        counters.misses++;
+    }
+
+    // Compile without holding the lock; if another thread won the race, keep
+    // its copy so every caller shares one pattern.
+    Entry compiled = compilePattern(ast, limits);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end())
+        return *it->second;
+
+    lru.push_front(compiled);
+    index[key] = lru.begin();
+    counters.entries++;
+    counters.bytes += compiled->bytes;
+    while (counters.bytes > maxBytes && lru.size() > 1)
+    {
+        const Entry &victim = lru.back();
+        counters.bytes -= victim->bytes;
+        counters.entries--;
+        counters.evictions++;
+        index.erase(victim->key);
+        lru.pop_back();
+    }
+    return compiled;
+}
+
+PatternCacheStats PatternCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void PatternCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    index.clear();
+    counters.entries = 0;
+    counters.bytes = 0;
+}
+
+PatternCache &globalPatternCache()
+{
+    static PatternCache cache;
+    return cache;
+}
+
+DFABuildOptions defaultBuildLimits()
+{
+    DFABuildOptions limits;
+    limits.maxBytes = 64 << 20;
+    return limits;
+}
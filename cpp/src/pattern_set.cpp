@@ -0,0 +1,16 @@
+#include "pattern_set.h"
+#include "nfa.h"
+
+PatternSet compilePatternSet(const std::vector<std::string> &regexes)
+{
+    std::vector<FlatNFA> nfas;
+    nfas.reserve(regexes.size());
+    for (const auto &regex : regexes)
+        nfas.push_back(flattenNFA(regexToNFA(regex)));
+
+    PatternSet set;
+    set.patterns = regexes;
+    set.dfa = minimizeDFA(convertNFAtoDFA(unionNFAs(nfas)));
+    set.dense = compileDFA(set.dfa);
+    return set;
+}
@@ -0,0 +1,112 @@
+#include "pike_vm.h"
+#include <utility>
+
+PikeProgram compilePikeProgram(const FlatNFA &nfa)
+{
+    auto isAccept = [&](uint32_t s)
+    {
+        if (nfa.accepts.empty())
+            return s == nfa.accept;
+        for (uint32_t a : nfa.accepts)
+            if (a == s)
+                return true;
+        return false;
+    };
+    auto edgeCount = [&](uint32_t s)
+    {
+        return (nfa.epsOffsets[s + 1] - nfa.epsOffsets[s]) + (nfa.symOffsets[s + 1] - nfa.symOffsets[s]) + (isAccept(s) ? 1 : 0);
+    };
+
+    // k edges take one instruction each plus k - 1 Splits in front of them.
+    std::vector<uint32_t> pcOf(nfa.numStates + 1, 0);
+    for (uint32_t s = 0; s < nfa.numStates; ++s)
+    {
+        uint32_t k = edgeCount(s);
+        pcOf[s + 1] = pcOf[s] + (k <= 1 ? 1 : 2 * k - 1);
+    }
+
+    PikeProgram program;
+    program.code.resize(pcOf[nfa.numStates]);
+    program.start = pcOf[nfa.start];
+    for (uint32_t s = 0; s < nfa.numStates; ++s)
+    {
+        std::vector<PikeInst> items;
+        for (uint32_t e = nfa.epsOffsets[s]; e < nfa.epsOffsets[s + 1]; ++e)
+            items.push_back({PikeInst::Jump, 0, 0, pcOf[nfa.epsTargets[e]], 0});
+        for (uint32_t e = nfa.symOffsets[s]; e < nfa.symOffsets[s + 1]; ++e)
+            items.push_back({PikeInst::Range, nfa.symRanges[e].lo, nfa.symRanges[e].hi, pcOf[nfa.symTargets[e]], 0});
+        if (isAccept(s))
+            items.push_back({PikeInst::Match, 0, 0, 0, 0});
+
+        uint32_t pc = pcOf[s];
+        if (items.empty())
+        {
+            program.code[pc] = {PikeInst::Fail, 0, 0, 0, 0};
+            continue;
+        }
+        for (size_t i = 0; i + 1 < items.size(); ++i, pc += 2)
+        {
+            program.code[pc] = {PikeInst::Split, 0, 0, pc + 1, pc + 2}; // item i, then the rest of the chain
+            program.code[pc + 1] = items[i];
+        }
+        program.code[pc] = items.back();
+    }
+    return program;
+}
+
+PikeVM::PikeVM(const FlatNFA &nfa) : program(compilePikeProgram(nfa))
+{
+    current.reset(program.code.size());
+    next.reset(program.code.size());
+}
+
+// Follows Jump and Split edges from pc and queues the Range and Match
+// instructions it reaches. Every visited pc is recorded, which also stops
+// ε-cycles.
+void PikeVM::addThread(SparseSet &list, uint32_t pc)
+{
+    stack.push_back(pc);
+    while (!stack.empty())
+    {
+        uint32_t p = stack.back();
+        stack.pop_back();
+        if (list.contains(p))
+            continue;
+        list.insert(p);
+
+        const PikeInst &inst = program.code[p];
+        if (inst.op == PikeInst::Jump)
+        {
+            stack.push_back(inst.x);
+        }
+        else if (inst.op == PikeInst::Split)
+        {
+            stack.push_back(inst.y);
+            stack.push_back(inst.x);
+        }
+    }
+}
+
+bool PikeVM::match(const char *input, size_t length)
+{
+    current.size = 0;
+    addThread(current, program.start);
+
+    for (size_t i = 0; i < length && current.size; ++i)
+    {
+        next.size = 0;
+        for (uint32_t t = 0; t < current.size; ++t)
+        {
+            const PikeInst &inst = program.code[current.dense[t]];
+            unsigned char b = static_cast<unsigned char>(input[i]);
+            if (inst.op == PikeInst::Range && inst.lo <= b && b <= inst.hi)
+                addThread(next, inst.x);
+        }
+        std::swap(current, next);
+    }
+
+    for (uint32_t t = 0; t < current.size; ++t)
+        if (program.code[current.dense[t]].op == PikeInst::Match)
+            return true;
+    return false;
+}
@@ -0,0 +1,529 @@
+#include "regex_ast.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+RegexParseError::RegexParseError(const std::string &message, size_t position)
+    : std::runtime_error(message + " at position " + std::to_string(position)), position(position)
+{
+}
+
+namespace
+{
+    constexpr int kMaxNesting = 1000; // keeps hostile patterns from exhausting the stack
+    constexpr uint32_t kMaxCount = 1000;
+    constexpr uint32_t kMaxCodepoint = 0x10FFFF;
+
+    // Sorts the ranges and merges those that overlap or touch.
+    CodepointSet normalized(CodepointSet set)
+    {
+        std::sort(set.begin(), set.end());
+        CodepointSet merged;
+        for (auto [lo, hi] : set)
+        {
+            if (!merged.empty() && lo <= merged.back().second + 1)
+                merged.back().second = std::max(merged.back().second, hi);
+            else
+                merged.push_back({lo, hi});
+        }
+        return merged;
+    }
+
+    // The values of [0, max] missing from a normalized set.
+    CodepointSet complement(const CodepointSet &set, uint32_t max)
+    {
+        CodepointSet result;
+        uint32_t next = 0;
+        for (auto [lo, hi] : set)
+        {
+            if (lo > next)
+                result.push_back({next, lo - 1});
+            next = hi + 1;
+        }
+        if (next <= max)
+            result.push_back({next, max});
+        return result;
+    }
+
+    // UTF-16 surrogates are not scalar values and have no UTF-8 encoding.
+    CodepointSet withoutSurrogates(const CodepointSet &set)
+    {
+        CodepointSet result;
+        for (auto [lo, hi] : set)
+        {
+            if (lo < 0xD800)
+                result.push_back({lo, std::min(hi, 0xD7FFu)});
+            if (hi > 0xDFFF)
+                result.push_back({std::max(lo, 0xE000u), hi});
+        }
+        return result;
+    }
+
+    std::string hexByte(char c)
+    {
+        char hex[8];
+        std::snprintf(hex, sizeof(hex), "0x%02x", static_cast<unsigned char>(c));
+        return hex;
+    }
+
+    int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    }
+
+    class Parser
+    {
+    public:
+        explicit Parser(const std::string &pattern) : pattern(pattern) {}
+
+        RegexAST parse()
+        {
+            if (pattern.compare(0, 4, "(?u)") == 0)
+            {
+                utf8 = true;
+                pos = 4;
+            }
+            parseAlternation();
+            // An alternation stops early only at a ')' with no '(' to close.
+            if (pos < pattern.size())
+                throw RegexParseError("unmatched ')'", pos);
+            ast.nodes.back().begin = 0; // the root spans the (?u) prefix too
+            return std::move(ast);
+        }
+
+    private:
+        uint32_t add(RegexNode::Kind kind, uint32_t left, uint32_t right, size_t begin, size_t end)
+        {
+            RegexNode node;
+            node.kind = kind;
+            node.left = left;
+            node.right = right;
+            node.begin = static_cast<uint32_t>(begin);
+            node.end = static_cast<uint32_t>(end);
+            ast.nodes.push_back(node);
+            uint32_t inner = std::max(left != RegexNode::kNone ? repeatDepth[left] : 0,
+                                      right != RegexNode::kNone ? repeatDepth[right] : 0);
+            repeatDepth.push_back(inner + (kind == RegexNode::Repeat));
+            return static_cast<uint32_t>(ast.nodes.size() - 1);
+        }
+
+        // A one-byte set becomes a Literal so literal extraction sees it.
+        uint32_t addSet(const ByteSet &set, size_t begin)
+        {
+            uint32_t node = add(RegexNode::Class, RegexNode::kNone, RegexNode::kNone, begin, pos);
+            if (set.count() == 1)
+            {
+                int b = 0;
+                while (!set.test(b))
+                    ++b;
+                ast.nodes[node].kind = RegexNode::Literal;
+                ast.nodes[node].byte = static_cast<char>(b);
+                return node;
+            }
+            ast.nodes[node].set = static_cast<uint32_t>(ast.sets.size());
+            ast.sets.push_back(set);
+            return node;
+        }
+
+        // The UTF-8 bytes of one codepoint as a chain of Literals.
+        uint32_t addCodepoint(uint32_t codepoint, size_t begin)
+        {
+            std::string bytes = utf8Encode(codepoint);
+            uint32_t node = addSet(ByteSet().set(static_cast<unsigned char>(bytes[0])), begin);
+            for (size_t i = 1; i < bytes.size(); ++i)
+            {
+                uint32_t next = addSet(ByteSet().set(static_cast<unsigned char>(bytes[i])), begin);
+                node = add(RegexNode::Concat, node, next, begin, pos);
+            }
+            return node;
+        }
+
+        // A set of units: bytes by default, codepoints under (?u). Codepoint
+        // sets reaching past ASCII become Utf8Class nodes.
+        uint32_t addUnits(const CodepointSet &set, size_t begin)
+        {
+            CodepointSet scalars = utf8 ? withoutSurrogates(set) : set;
+            if (utf8 && !scalars.empty() && scalars.back().second >= 0x80)
+            {
+                if (scalars.size() == 1 && scalars[0].first == scalars[0].second)
+                    return addCodepoint(scalars[0].first, begin);
+                uint32_t node = add(RegexNode::Utf8Class, RegexNode::kNone, RegexNode::kNone, begin, pos);
+                ast.nodes[node].set = static_cast<uint32_t>(ast.codepointSets.size());
+                ast.codepointSets.push_back(std::move(scalars));
+                return node;
+            }
+            ByteSet bytes;
+            for (auto [lo, hi] : scalars)
+                for (uint32_t b = lo; b <= hi; ++b)
+                    bytes.set(b);
+            return addSet(bytes, begin);
+        }
+
+        uint32_t maxUnit() const { return utf8 ? kMaxCodepoint : 0xFF; }
+
+        bool at(char c) const { return pos < pattern.size() && pattern[pos] == c; }
+
+        uint32_t parseAlternation()
+        {
+            uint32_t node = parseConcat();
+            while (at('|'))
+            {
+                ++pos;
+                uint32_t rhs = parseConcat();
+                node = add(RegexNode::Alternate, node, rhs, ast.nodes[node].begin, ast.nodes[rhs].end);
+            }
+            return node;
+        }
+
+        uint32_t parseConcat()
+        {
+            uint32_t node = RegexNode::kNone;
+            while (pos < pattern.size() && !at('|') && !at(')'))
+            {
+                uint32_t rhs = parseRepeat();
+                node = node == RegexNode::kNone
+                           ? rhs
+                           : add(RegexNode::Concat, node, rhs, ast.nodes[node].begin, ast.nodes[rhs].end);
+            }
+            return node == RegexNode::kNone ? add(RegexNode::Empty, RegexNode::kNone, RegexNode::kNone, pos, pos) : node;
+        }
+
+        uint32_t parseRepeat()
+        {
+            size_t first = ast.nodes.size();
+            uint32_t node = parseAtom();
+            while (at('*') || at('+') || at('?') || at('{'))
+            {
+                if (at('{'))
+                {
+                    node = parseCount(node, first);
+                    continue;
+                }
+                RegexNode::Kind kind = at('*') ? RegexNode::Star : at('+') ? RegexNode::Plus : RegexNode::Question;
+                ++pos;
+                node = add(kind, node, RegexNode::kNone, ast.nodes[node].begin, pos);
+            }
+            return node;
+        }
+
+        uint32_t parseNumber(size_t brace)
+        {
+            if (pos == pattern.size() || !std::isdigit(static_cast<unsigned char>(pattern[pos])))
+                throw RegexParseError("expected a repetition count", pos);
+            uint32_t value = 0;
+            while (pos < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[pos])))
+            {
+                value = value * 10 + (pattern[pos++] - '0');
+                if (value > kMaxCount)
+                    throw RegexParseError("repetition count above " + std::to_string(kMaxCount), brace);
+            }
+            return value;
+        }
+
+        // {m}, {m,} or {m,n} applied to `node`, whose subtree starts at
+        // nodes[first]. Bounds that *, + or ? express become those nodes,
+        // {1} is the operand itself and {0} drops the operand's subtree.
+        uint32_t parseCount(uint32_t node, size_t first)
+        {
+            size_t brace = pos++;
+            uint32_t min = parseNumber(brace), max = min;
+            if (at(','))
+            {
+                ++pos;
+                max = at('}') ? RegexNode::kUnbounded : parseNumber(brace);
+            }
+            if (!at('}'))
+                throw RegexParseError("unclosed '{'", brace);
+            ++pos;
+            if (max < min)
+                throw RegexParseError("repetition range out of order", brace);
+
+            size_t begin = ast.nodes[node].begin;
+            if (max == 0)
+            {
+                ast.nodes.resize(first);
+                repeatDepth.resize(first);
+                return add(RegexNode::Empty, RegexNode::kNone, RegexNode::kNone, begin, pos);
+            }
+            if (min == 1 && max == 1)
+            {
+                ast.nodes[node].end = static_cast<uint32_t>(pos);
+                return node;
+            }
+            if (max == RegexNode::kUnbounded && min <= 1)
+                return add(min == 0 ? RegexNode::Star : RegexNode::Plus, node, RegexNode::kNone, begin, pos);
+            if (min == 0 && max == 1)
+                return add(RegexNode::Question, node, RegexNode::kNone, begin, pos);
+            // Automaton builders recurse once per nested counted repetition,
+            // and a{2}{2}... nests without any group.
+            if (repeatDepth[node] >= static_cast<uint32_t>(kMaxNesting))
+                throw RegexParseError("counted repetitions nested deeper than " + std::to_string(kMaxNesting), brace);
+            uint32_t repeat = add(RegexNode::Repeat, node, RegexNode::kNone, begin, pos);
+            ast.nodes[repeat].min = min;
+            ast.nodes[repeat].max = max;
+            return repeat;
+        }
+
+        uint32_t parseAtom()
+        {
+            size_t begin = pos;
+            char c = pattern[pos];
+            if (c == '(')
+            {
+                if (++depth > kMaxNesting)
+                    throw RegexParseError("groups nested deeper than " + std::to_string(kMaxNesting), begin);
+                ++pos;
+                uint32_t inner = parseAlternation();
+                if (!at(')'))
+                    throw RegexParseError("unclosed '('", begin);
+                ++pos;
+                --depth;
+                ast.nodes[inner].begin = static_cast<uint32_t>(begin);
+                ast.nodes[inner].end = static_cast<uint32_t>(pos);
+                return inner;
+            }
+            if (c == '*' || c == '+' || c == '?' || c == '{')
+                throw RegexParseError("nothing to repeat", begin);
+            if (c == '[')
+                return addUnits(parseClass(), begin);
+            if (c == '.')
+            {
+                ++pos;
+                return addUnits(complement({{'\n', '\n'}}, maxUnit()), begin);
+            }
+            if (c == '\\' && !utf8 && pos + 1 < pattern.size() && pattern[pos + 1] == 'u')
+            {
+                pos += 2;
+                return addCodepoint(parseCodepointEscape(begin), begin);
+            }
+            if (c == '\\')
+                return addUnits(parseEscape(), begin);
+            if (static_cast<unsigned char>(c) >= 0x80)
+                return addCodepoint(parseUtf8(), begin);
+            return addSet(ByteSet().set(static_cast<unsigned char>(parseByte())), begin);
+        }
+
+        // A raw ASCII pattern byte used as a literal.
+        char parseByte()
+        {
+            char c = pattern[pos];
+            if (c < 0x20 || c > 0x7e)
+                throw RegexParseError("unexpected byte " + hexByte(c), pos);
+            ++pos;
+            return c;
+        }
+
+        // The UTF-8 encoded character whose lead byte is at pos. Overlong
+        // forms, surrogates and values past U+10FFFF are rejected.
+        uint32_t parseUtf8()
+        {
+            static const uint32_t kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+            size_t begin = pos;
+            unsigned char lead = static_cast<unsigned char>(pattern[pos]);
+            int length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+            uint32_t codepoint = lead & (0x7F >> length);
+            for (int i = 1; i < length; ++i)
+            {
+                if (begin + i >= pattern.size() || (pattern[begin + i] & 0xC0) != 0x80)
+                {
+                    length = 0;
+                    break;
+                }
+                codepoint = codepoint << 6 | (pattern[begin + i] & 0x3F);
+            }
+            if (length == 0 || lead > 0xF4 || codepoint < kMinimum[length] || codepoint > kMaxCodepoint ||
+                (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+                throw RegexParseError("invalid UTF-8 at byte " + hexByte(pattern[begin]), begin);
+            pos += length;
+            return codepoint;
+        }
+
+        // \u{H..} with up to six digits or \uHHHH; pos is past the 'u'.
+        uint32_t parseCodepointEscape(size_t begin)
+        {
+            bool braced = at('{');
+            if (braced)
+                ++pos;
+            uint32_t value = 0;
+            int digits = 0;
+            while (pos < pattern.size() && hexDigit(pattern[pos]) >= 0 && digits < (braced ? 6 : 4))
+            {
+                value = value * 16 + hexDigit(pattern[pos++]);
+                ++digits;
+            }
+            if (braced ? digits == 0 || !at('}') : digits != 4)
+                throw RegexParseError("\\u needs four hex digits or {H..}", begin);
+            if (braced)
+                ++pos;
+            if (value > kMaxCodepoint || (value >= 0xD800 && value <= 0xDFFF))
+                throw RegexParseError("\\u escape is not a Unicode scalar value", begin);
+            return value;
+        }
+
+        // One codepoint as a class member; without (?u) classes are bytes, so
+        // only ASCII is allowed.
+        CodepointSet single(uint32_t codepoint, size_t begin)
+        {
+            if (!utf8 && codepoint >= 0x80)
+                throw RegexParseError("non-ASCII class member needs (?u)", begin);
+            return {{codepoint, codepoint}};
+        }
+
+        // The units matched by the escape at pos, which is on the '\'.
+        CodepointSet parseEscape()
+        {
+            size_t begin = pos++;
+            if (pos == pattern.size())
+                throw RegexParseError("trailing '\\'", begin);
+            char c = pattern[pos++];
+            const CodepointSet digit = {{'0', '9'}};
+            const CodepointSet word = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+            const CodepointSet space = {{'\t', '\r'}, {' ', ' '}};
+            switch (c)
+            {
+            case 'd':
+                return digit;
+            case 'D':
+                return complement(digit, maxUnit());
+            case 'w':
+                return word;
+            case 'W':
+                return complement(word, maxUnit());
+            case 's':
+                return space;
+            case 'S':
+                return complement(space, maxUnit());
+            case 'n':
+                return {{'\n', '\n'}};
+            case 't':
+                return {{'\t', '\t'}};
+            case 'r':
+                return {{'\r', '\r'}};
+            case 'f':
+                return {{'\f', '\f'}};
+            case 'v':
+                return {{'\v', '\v'}};
+            case '0':
+                return {{0, 0}};
+            case 'x':
+            {
+                int hi = pos < pattern.size() ? hexDigit(pattern[pos]) : -1;
+                int lo = pos + 1 < pattern.size() ? hexDigit(pattern[pos + 1]) : -1;
+                if (hi < 0 || lo < 0)
+                    throw RegexParseError("\\x needs two hex digits", begin);
+                pos += 2;
+                uint32_t value = static_cast<uint32_t>(hi * 16 + lo);
+                return {{value, value}};
+            }
+            case 'u':
+                return single(parseCodepointEscape(begin), begin);
+            default:
+                if (std::ispunct(static_cast<unsigned char>(c)))
+                {
+                    uint32_t value = static_cast<unsigned char>(c);
+                    return {{value, value}};
+                }
+                throw RegexParseError(std::string("unknown escape '\\") + c + "'", begin);
+            }
+        }
+
+        // One class member: a character, or a set escape such as \d.
+        CodepointSet parseClassItem()
+        {
+            if (at('\\'))
+                return parseEscape();
+            size_t begin = pos;
+            if (static_cast<unsigned char>(pattern[pos]) >= 0x80)
+                return single(parseUtf8(), begin);
+            uint32_t value = static_cast<unsigned char>(parseByte());
+            return {{value, value}};
+        }
+
+        // '[' '^'? item+ ']' where an item is a character, a range lo-hi or
+        // an escape. ']' first and '-' first or last are literal.
+        CodepointSet parseClass()
+        {
+            size_t begin = pos++;
+            bool negated = at('^');
+            if (negated)
+                ++pos;
+            CodepointSet set;
+            bool first = true;
+            while (pos < pattern.size() && (first || !at(']')))
+            {
+                first = false;
+                size_t itemBegin = pos;
+                CodepointSet lo = parseClassItem();
+                if (!at('-') || pos + 1 >= pattern.size() || pattern[pos + 1] == ']')
+                {
+                    set.insert(set.end(), lo.begin(), lo.end());
+                    continue;
+                }
+                ++pos;
+                CodepointSet hi = parseClassItem();
+                if (lo.size() != 1 || lo[0].first != lo[0].second || hi.size() != 1 || hi[0].first != hi[0].second)
+                    throw RegexParseError("class escape used as a range bound", itemBegin);
+                if (lo[0].first > hi[0].first)
+                    throw RegexParseError("range out of order", itemBegin);
+                set.push_back({lo[0].first, hi[0].first});
+            }
+            if (!at(']'))
+                throw RegexParseError("unclosed '['", begin);
+            ++pos;
+            set = normalized(std::move(set));
+            return negated ? complement(set, maxUnit()) : set;
+        }
+
+        const std::string &pattern;
+        size_t pos = 0;
+        int depth = 0;
+        std::vector<uint32_t> repeatDepth; // node -> counted repetitions nested in its subtree
+        bool utf8 = false; // (?u): '.', classes and \D \W \S match codepoints
+        RegexAST ast;
+    };
+}
+
+RegexAST parseRegex(const std::string &regex)
+{
+    return Parser(regex).parse();
+}
+
+std::string utf8Encode(uint32_t codepoint)
+{
+    std::string bytes;
+    if (codepoint < 0x80)
+    {
+        bytes += static_cast<char>(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        bytes += static_cast<char>(0xC0 | codepoint >> 6);
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        bytes += static_cast<char>(0xE0 | codepoint >> 12);
+        bytes += static_cast<char>(0x80 | (codepoint >> 6 & 0x3F));
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        bytes += static_cast<char>(0xF0 | codepoint >> 18);
+        bytes += static_cast<char>(0x80 | (codepoint >> 12 & 0x3F));
+        bytes += static_cast<char>(0x80 | (codepoint >> 6 & 0x3F));
+        bytes += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    return bytes;
+}
+
+std::vector<uint32_t> subtreeFirst(const RegexAST &ast)
+{
+    std::vector<uint32_t> first(ast.nodes.size());
+    for (uint32_t i = 0; i < ast.nodes.size(); ++i)
+        first[i] = ast.nodes[i].left == RegexNode::kNone ? i : first[ast.nodes[i].left];
+    return first;
+}
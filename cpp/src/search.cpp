@@ -0,0 +1,123 @@
+#include "search.h"
+
+namespace
+{
+    DenseDFA build(const FlatNFA &nfa, bool unanchored)
+    {
+        DFABuildOptions options;
+        options.unanchored = unanchored;
+        return compileDFA(minimizeDFA(convertNFAtoDFA(nfa, options)));
+    }
+
+    inline uint32_t step(const DenseDFA &dfa, uint32_t state, char c)
+    {
+        return dfa.table[state * dfa.numClasses + dfa.classOf[static_cast<unsigned char>(c)]];
+    }
+}
+
+Searcher::Searcher(const FlatNFA &nfa)
+    : forward(build(nfa, false)),
+      unanchored(build(nfa, true)),
+      reverse(build(reverseNFA(nfa), true))
+{
+}
+
+bool Searcher::occurs(const char *data, size_t size) const
+{
+    uint32_t current = unanchored.start;
+    if (unanchored.isAccept(current))
+        return true;
+    for (size_t i = 0; i < size; ++i)
+    {
+        current = step(unanchored, current, data[i]);
+        if (unanchored.isAccept(current))
+            return true;
+    }
+    return false;
+}
+
+// Reading the text backwards, the reverse DFA is accepting after it has
+// consumed data[i..size) exactly when some match of R starts at i.
+std::vector<uint64_t> Searcher::matchStarts(const char *data, size_t size) const
+{
+    std::vector<uint64_t> starts(size / 64 + 1, 0);
+    uint32_t current = reverse.start;
+    if (reverse.isAccept(current))
+        starts[size >> 6] |= uint64_t(1) << (size & 63);
+    for (size_t i = size; i-- > 0;)
+    {
+        current = step(reverse, current, data[i]);
+        if (reverse.isAccept(current))
+            starts[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+    return starts;
+}
+
+// End of the longest match starting at `start`; the caller guarantees that
+// one exists.
+size_t Searcher::longestFrom(const char *data, size_t size, size_t start) const
+{
+    uint32_t current = forward.start;
+    size_t end = start;
+    for (size_t i = start; i < size; ++i)
+    {
+        current = step(forward, current, data[i]);
+        if (current == forward.dead)
+            break;
+        if (forward.isAccept(current))
+            end = i + 1;
+    }
+    return end;
+}
+
+bool Searcher::find(const char *data, size_t size, Match &match) const
+{
+    // The leftmost start is the last accepting position of the backward pass.
+    uint32_t current = reverse.start;
+    size_t start = reverse.isAccept(current) ? size : SIZE_MAX;
+    for (size_t i = size; i-- > 0;)
+    {
+        current = step(reverse, current, data[i]);
+        if (reverse.isAccept(current))
+            start = i;
+    }
+    if (start == SIZE_MAX)
+        return false;
+    match.start = start;
+    match.end = longestFrom(data, size, start);
+    return true;
+}
+
+std::vector<Match> Searcher::findAll(const char *data, size_t size) const
+{
+    std::vector<Match> matches;
+    if (!occurs(data, size))
+        return matches;
+
+    const std::vector<uint64_t> starts = matchStarts(data, size);
+    size_t pos = 0;
+    while (pos <= size)
+    {
+        // Next start at or after pos.
+        size_t word = pos >> 6;
+        uint64_t bits = starts[word] & (~uint64_t(0) << (pos & 63));
+        while (!bits && ++word < starts.size())
+            bits = starts[word];
+        if (!bits)
+            break;
+        size_t start = (word << 6) + static_cast<size_t>(__builtin_ctzll(bits));
+        if (start > size)
+            break;
+
+        size_t end = longestFrom(data, size, start);
+        // An empty match right where the previous match ended is not reported.
+        if (end == start && !matches.empty() && matches.back().end == start)
+        {
+            pos = start + 1;
+            continue;
+        }
+        matches.push_back({start, end});
+        pos = end > start ? end : start + 1;
+    }
+    return matches;
+}
@@ -0,0 +1,170 @@
+#include "serve.h"
+#include "pattern_cache.h"
+#include "lazy_dfa.h"
+#include <filesystem>
+#include <memory>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace
+{
+    DFABuildOptions limitsOf(const json &request, const DFABuildOptions &defaults)
+    {
+        DFABuildOptions limits = defaults;
+        limits.maxStates = request.value("max_states", defaults.maxStates);
+        limits.maxBytes = request.value("max_bytes", defaults.maxBytes);
+        return limits;
+    }
+
+    json limitError(const DFABuildError &e)
+    {
+        return {{"status", "error"},
+                {"error", e.what()},
+                {"limit", e.limitName()},
+                {"states", e.states},
+                {"bytes", e.bytes},
+                {"max_states", e.options.maxStates},
+                {"max_bytes", e.options.maxBytes}};
+    }
+
+    // Past the DFA limits the input is matched by a lazy DFA whose cache is
+    // bounded by the same byte limit; it degrades to NFA simulation if needed.
+    json simulateLazy(const json &request, const DFABuildError &e)
+    {
+        RegexAST ast = parseRegex(request.at("regex").get<std::string>());
+        if (e.options.maxBytes && estimateRegexSize(ast).nfaBytes() > e.options.maxBytes)
+            return limitError(e); // the NFA itself is over the limit
+
+        LazyDFAOptions options;
+        if (e.options.maxBytes)
+            options.memoryBudget = options.maxClosureBytes = e.options.maxBytes;
+        std::unique_ptr<LazyDFA> lazy;
+        try
+        {
+            lazy = std::make_unique<LazyDFA>(flattenNFA(regexToNFA(ast)), options);
+        }
+        catch (const DFABuildError &closureError)
+        {
+            return limitError(DFABuildError(DFABuildError::MaxBytes, 0, closureError.bytes, e.options));
+        }
+        bool accepted = lazy->match(request.at("input").get<std::string>());
+
+        json fallback = limitError(e);
+        fallback.erase("status");
+        return {{"status", "ok"},
+                {"accepted", accepted},
+                {"engine", lazy->stats().fellBack ? "nfa" : "lazy"},
+                {"fallback", fallback}};
+    }
+
+    json simulate(const json &request, const DFABuildOptions &defaults)
+    {
+        std::shared_ptr<const CompiledPattern> pattern;
+        try
+        {
+            pattern = globalPatternCache().get(request.at("regex").get<std::string>(), limitsOf(request, defaults));
+        }
+        catch (const DFABuildError &e)
+        {
+            return request.value("fallback", true) ? simulateLazy(request, e) : limitError(e);
+        }
+        bool minimized = request.value("minimized", false);
+        const DFA &dfa = minimized ? pattern->minDFA : pattern->dfa;
+
+        const DenseDFA &dense = minimized ? pattern->denseMin : pattern->dense;
+        const std::string input = request.at("input").get<std::string>();
+        if (!request.value("trace", true))
+            return {{"status", "ok"},
+                    {"accepted", matchDFA(dense, input)},
+                    {"engine", "dfa"},
+                    {"states", dfa.states.size()}};
+
+        std::vector<int> trace;
+        bool accepted = simulateDFA(dense, input, trace);
+        return {{"status", "ok"},
+                {"accepted", accepted},
+                {"engine", "dfa"},
+                {"trace", trace},
+                {"states", dfa.states.size()}};
+    }
+
+    json exportJson(const json &request, const DFABuildOptions &defaults)
+    {
+        std::shared_ptr<const CompiledPattern> pattern;
+        try
+        {
+            pattern = globalPatternCache().get(request.at("regex").get<std::string>(), limitsOf(request, defaults));
+        }
+        catch (const DFABuildError &e)
+        {
+            return limitError(e);
+        }
+        std::filesystem::create_directories("output");
+
+        std::ofstream("output/nfa.json") << exportToJson(pattern->nfa).dump(4);
+        std::ofstream("output/dfa.json") << exportDFAtoJson(pattern->dfa).dump(4);
+        if (request.value("minimized", false))
+            std::ofstream("output/min_dfa.json") << exportDFAtoJson(pattern->minDFA).dump(4);
+        return {{"status", "ok"}};
+    }
+
+    json cacheStats()
+    {
+        PatternCacheStats stats = globalPatternCache().stats();
+        return {{"status", "ok"},
+                {"hits", stats.hits},
+                {"misses", stats.misses},
+                {"evictions", stats.evictions},
+                {"entries", stats.entries},
+                {"bytes", stats.bytes}};
+    }
+}
+
+json handleServeRequest(const json &request, const DFABuildOptions &defaults)
+{
+    std::string op = request.value("op", "");
+    try
+    {
+        if (op == "simulate")
+            return simulate(request, defaults);
+        if (op == "export")
+            return exportJson(request, defaults);
+    }
+    catch (const RegexParseError &e)
+    {
+        return {{"status", "error"}, {"error", e.what()}, {"position", e.position}};
+    }
+    if (op == "stats")
+        return cacheStats();
+    return {{"status", "error"}, {"error", "unknown op: " + op}};
+}
+
+void runServeMode(std::istream &in, std::ostream &out, const DFABuildOptions &defaults)
+{
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+            continue;
+
+        json response;
+        json id;
+        try
+        {
+            json request = json::parse(line);
+            id = request.value("id", json());
+            response = handleServeRequest(request, defaults);
+        }
+        catch (const std::exception &e)
+        {
+            response = {{"status", "error"}, {"error", e.what()}};
+        }
+        if (!id.is_null())
+            response["id"] = id;
+        out << response.dump() << "\n";
+        out.flush();
+    }
+}
@@ -0,0 +1,47 @@
+#include "shift_and.h"
+
+ShiftAndMatcher::ShiftAndMatcher(const GlushkovNFA &nfa)
+{
+    const size_t states = nfa.positions() + 1;
+    std::vector<uint64_t> follow(states, 0);
+    for (size_t p = 0; p < states; ++p)
+    {
+        for (int b = 0; p > 0 && b < 256; ++b)
+            if (nfa.symbol[p].test(b))
+                symbolMask[b] |= uint64_t(1) << p;
+        for (uint32_t q : nfa.follow[p])
+            follow[p] |= uint64_t(1) << q;
+    }
+    for (uint32_t p : nfa.finals)
+        finalMask |= uint64_t(1) << p;
+
+    // Follow(D) is the union of follow[p] over the set bits p of D; it is
+    // looked up one byte of D at a time.
+    followTables.resize((states + 7) / 8);
+    for (size_t k = 0; k < followTables.size(); ++k)
+        for (unsigned bits = 0; bits < 256; ++bits)
+        {
+            uint64_t targets = 0;
+            for (size_t b = 0; b < 8 && 8 * k + b < states; ++b)
+                if (bits & (1u << b))
+                    targets |= follow[8 * k + b];
+            followTables[k][bits] = targets;
+        }
+}
+
+bool ShiftAndMatcher::match(const char *input, size_t length) const
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    const size_t tables = followTables.size();
+    uint64_t active = 1;
+    for (size_t i = 0; i < length; ++i)
+    {
+        uint64_t next = 0;
+        for (size_t k = 0; k < tables; ++k)
+            next |= followTables[k][(active >> (8 * k)) & 0xff];
+        active = next & symbolMask[bytes[i]];
+        if (!active)
+            return false;
+    }
+    return (active & finalMask) != 0;
+}
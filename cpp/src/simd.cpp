@@ -0,0 +1,252 @@
+#include "simd.h"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct Line
+    {
+        const unsigned char *data;
+        size_t length;
+    };
+
+    const char *findNewlineScalar(const char *begin, const char *end)
+    {
+        const void *hit = memchr(begin, '\n', static_cast<size_t>(end - begin));
+        return hit ? static_cast<const char *>(hit) : end;
+    }
+
+    const char *findLiteralScalar(const char *p, const char *end, const char *literal, size_t n)
+    {
+        while (end - p >= static_cast<ptrdiff_t>(n))
+        {
+            const char *hit = static_cast<const char *>(memchr(p, literal[0], static_cast<size_t>(end - p) - n + 1));
+            if (!hit)
+                break;
+            if (memcmp(hit + 1, literal + 1, n - 1) == 0)
+                return hit;
+            p = hit + 1;
+        }
+        return end;
+    }
+
+    bool stepScalar(const ShuffleDFA &dfa, const Line &line)
+    {
+        uint8_t state = dfa.start;
+        for (size_t i = 0; i < line.length; ++i)
+            state = dfa.rows[dfa.classOf[line.data[i]] * 16 + state];
+        return (dfa.acceptMask >> state) & 1;
+    }
+
+#ifdef SIMD_X86
+    __attribute__((target("avx2"))) const char *findNewlineAVX2(const char *p, const char *end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+        return findNewlineScalar(p, end);
+    }
+
+    __attribute__((target("sse2"))) const char *findNewlineSSE2(const char *p, const char *end)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+        return findNewlineScalar(p, end);
+    }
+
+    // Compares the first and the last byte of the literal at 32 positions at
+    // once and only verifies the candidates where both agree.
+    __attribute__((target("avx2"))) const char *findLiteralAVX2(const char *p, const char *end, const char *literal, size_t n)
+    {
+        const __m256i first = _mm256_set1_epi8(literal[0]);
+        const __m256i last = _mm256_set1_epi8(literal[n - 1]);
+        for (; end - p >= static_cast<ptrdiff_t>(32 + n - 1); p += 32)
+        {
+            __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + n - 1));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+            for (; mask; mask &= mask - 1)
+            {
+                const char *candidate = p + __builtin_ctz(mask);
+                if (memcmp(candidate + 1, literal + 1, n - 1) == 0)
+                    return candidate;
+            }
+        }
+        return findLiteralScalar(p, end, literal, n);
+    }
+
+    // Runs up to 16 lines in parallel lanes. Each step gathers one byte class
+    // per lane (finished lanes get the out-of-range class numClasses and keep
+    // their state) and applies every class row that occurs with a masked
+    // PSHUFB. The group stops early once every lane is in the dead state.
+    __attribute__((target("ssse3"))) void classifyGroupSSSE3(const ShuffleDFA &dfa, const Line *lines, size_t count, uint8_t *verdicts)
+    {
+        size_t maxLength = 0;
+        for (size_t l = 0; l < count; ++l)
+            maxLength = std::max(maxLength, lines[l].length);
+
+        const uint8_t finished = static_cast<uint8_t>(dfa.numClasses);
+        alignas(16) uint8_t classes[16];
+        const __m128i dead = _mm_set1_epi8(static_cast<char>(dfa.dead));
+        __m128i state = _mm_set1_epi8(static_cast<char>(dfa.start));
+        for (size_t i = 0; i < maxLength; ++i)
+        {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(state, dead)) == 0xFFFF)
+                break;
+            for (size_t l = 0; l < 16; ++l)
+                classes[l] = (l < count && i < lines[l].length) ? dfa.classOf[lines[l].data[i]] : finished;
+            __m128i laneClass = _mm_load_si128(reinterpret_cast<const __m128i *>(classes));
+
+            __m128i next = state;
+            for (uint32_t c = 0; c < dfa.numClasses; ++c)
+            {
+                __m128i mask = _mm_cmpeq_epi8(laneClass, _mm_set1_epi8(static_cast<char>(c)));
+                if (!_mm_movemask_epi8(mask))
+                    continue;
+                __m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&dfa.rows[c * 16]));
+                __m128i stepped = _mm_shuffle_epi8(row, state);
+                next = _mm_or_si128(_mm_and_si128(mask, stepped), _mm_andnot_si128(mask, next));
+            }
+            state = next;
+        }
+
+        alignas(16) uint8_t finalStates[16];
+        _mm_store_si128(reinterpret_cast<__m128i *>(finalStates), state);
+        for (size_t l = 0; l < count; ++l)
+            verdicts[l] = (dfa.acceptMask >> finalStates[l]) & 1;
+    }
+#endif
+
+    using FindNewlineFn = const char *(*)(const char *, const char *);
+
+    FindNewlineFn resolveFindNewline()
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return findNewlineAVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return findNewlineSSE2;
+#endif
+        return findNewlineScalar;
+    }
+
+    using FindLiteralFn = const char *(*)(const char *, const char *, const char *, size_t);
+
+    FindLiteralFn resolveFindLiteral()
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return findLiteralAVX2;
+#endif
+        return findLiteralScalar;
+    }
+
+    bool hasSSSE3()
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3");
+#else
+        return false;
+#endif
+    }
+}
+
+const char *findNewline(const char *begin, const char *end)
+{
+    static const FindNewlineFn find = resolveFindNewline();
+    return find(begin, end);
+}
+
+const char *findLiteral(const char *begin, const char *end, const std::string &literal)
+{
+    static const FindLiteralFn find = resolveFindLiteral();
+    if (literal.empty())
+        return begin;
+    if (literal.size() == 1) // memchr is already vectorized
+        return findLiteralScalar(begin, end, literal.data(), 1);
+    return find(begin, end, literal.data(), literal.size());
+}
+
+const char *simdLevel()
+{
+    static const FindNewlineFn find = resolveFindNewline();
+#ifdef SIMD_X86
+    if (find == findNewlineAVX2)
+        return "avx2";
+    if (find == findNewlineSSE2)
+        return "sse2";
+#endif
+    return "scalar";
+}
+
+ShuffleDFA compileShuffleDFA(const DenseDFA &dfa)
+{
+    ShuffleDFA shuffle;
+    if (dfa.numStates > 16 || dfa.numClasses > 255)
+        return shuffle;
+
+    shuffle.usable = true;
+    shuffle.start = static_cast<uint8_t>(dfa.start);
+    shuffle.dead = static_cast<uint8_t>(dfa.dead);
+    shuffle.numClasses = dfa.numClasses;
+    shuffle.classOf = dfa.classOf;
+    // Unused lanes of a row point at the dead state, which only loops on itself.
+    shuffle.rows.assign(static_cast<size_t>(dfa.numClasses) * 16, static_cast<uint8_t>(dfa.dead));
+    for (uint32_t s = 0; s < dfa.numStates; ++s)
+    {
+        if (dfa.isAccept(s))
+            shuffle.acceptMask |= static_cast<uint16_t>(1u << s);
+        for (uint32_t c = 0; c < dfa.numClasses; ++c)
+            shuffle.rows[c * 16 + s] = static_cast<uint8_t>(dfa.table[static_cast<size_t>(s) * dfa.numClasses + c]);
+    }
+    return shuffle;
+}
+
+void classifyLines(const ShuffleDFA &dfa, const char *data, size_t size, std::vector<uint8_t> &verdicts)
+{
+    static const bool lanes = hasSSSE3();
+
+    std::vector<Line> lines;
+    const char *end = data + size;
+    while (data < end)
+    {
+        const char *newline = findNewline(data, end);
+        lines.push_back({reinterpret_cast<const unsigned char *>(data), static_cast<size_t>(newline - data)});
+        data = newline + 1;
+    }
+
+    size_t first = verdicts.size();
+    verdicts.resize(first + lines.size());
+    size_t l = 0;
+#ifdef SIMD_X86
+    if (lanes)
+    {
+        for (; l + 16 <= lines.size(); l += 16)
+            classifyGroupSSSE3(dfa, &lines[l], 16, &verdicts[first + l]);
+    }
+#else
+    (void)lanes;
+#endif
+    for (; l < lines.size(); ++l)
+        verdicts[first + l] = stepScalar(dfa, lines[l]);
+}
@@ -1,9 +1,25 @@
 #include "../include/nfa.h"
 #include "../include/dfa.h"
+#include "../include/lazy_dfa.h"
+#include "../include/serve.h"
+#include "../include/pattern_cache.h"
+#include "../include/batch.h"
+#include "../include/mapped_file.h"
+#include "../include/simd.h"
+#include "../include/search.h"
+#include "../include/pattern_set.h"
+#include "../include/shift_and.h"
+#include "../include/pike_vm.h"
 #include <iostream>
 #include <vector>
 #include <cassert>
 #include <set>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 
 // OK Check if accepted/rejected inputs match expectation
 void checkAccepts(const std::string &regex, const std::vector<std::string> &accepted, const std::vector<std::string> &rejected)
@@ -11,25 +27,134 @@ void checkAccepts(const std::string &regex, const std::vector<std::string> &acce
     std::cout << "cTesting regex: " << regex << "\n";
 
     NFA nfa = regexToNFA(regex);
-    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    DenseDFA dfa = compileDFA(convertNFAtoDFA(nfa.start, nfa.accept->id));
 
     for (const auto &input : accepted)
     {
-        std::vector<int> trace;
-        bool result = simulateDFA(dfa, input, trace);
+        bool result = matchDFA(dfa, input);
         std::cout << "  [OK] Accept test: \"" << input << "\" => " << (result ? "Passed" : "[X] Failed") << "\n";
         assert(result);
     }
 
     for (const auto &input : rejected)
     {
-        std::vector<int> trace;
-        bool result = simulateDFA(dfa, input, trace);
+        bool result = matchDFA(dfa, input);
         std::cout << "  [X] Reject test: \"" << input << "\" => " << (!result ? "Passed" : "[X] Failed") << "\n";
         assert(!result);
     }
 }
 
+// OK Check that a malformed regex is rejected at the offending byte
+void checkParseError(const std::string &regex, size_t position)
+{
+    try
+    {
+        parseRegex(regex);
+    }
+    catch (const RegexParseError &e)
+    {
+        std::cout << "  [OK] Parse error for \"" << (regex.size() > 20 ? regex.substr(0, 20) + "..." : regex)
+                  << "\": " << e.what() << "\n";
+        assert(e.position == position);
+        return;
+    }
+    assert(!"regex should not parse");
+}
+
+// OK Check a (?u) pattern of one codepoint class against `member` on every
+// scalar value, and that malformed UTF-8 never matches
+void checkUtf8Class(const std::string &regex, bool (*member)(uint32_t))
+{
+    DenseDFA dfa = compileDFA(minimizeDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex)))));
+    size_t matched = 0;
+    for (uint32_t cp = 0; cp <= 0x10FFFF; ++cp)
+    {
+        if (cp >= 0xD800 && cp <= 0xDFFF)
+            continue;
+        bool result = matchDFA(dfa, utf8Encode(cp));
+        assert(result == member(cp));
+        matched += result;
+    }
+    std::cout << "  ## UTF-8 class " << regex << ": " << matched << " codepoints, " << dfa.numStates
+              << " DFA states\n";
+    for (const char *bad : {"\xc0\x80", "\xe0\x80\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xc3", "\xa9", "\xff"})
+        assert(!matchDFA(dfa, bad));
+}
+
+// OK Check postorder layout and source spans of the AST
+void checkRegexAST(const std::string &regex, const std::string &expectedKey)
+{
+    RegexAST ast = parseRegex(regex);
+    for (uint32_t i = 0; i < ast.nodes.size(); ++i)
+    {
+        const RegexNode &node = ast[i];
+        assert(node.begin <= node.end && node.end <= regex.size());
+        for (uint32_t child : {node.left, node.right})
+            if (child != RegexNode::kNone)
+            {
+                assert(child < i);
+                assert(node.begin <= ast[child].begin && ast[child].end <= node.end);
+            }
+    }
+    assert(ast[ast.root()].begin == 0 && ast[ast.root()].end == regex.size());
+    std::cout << "  [OK] AST of \"" << regex << "\": " << ast.nodes.size() << " nodes, key " << canonicalRegex(ast) << "\n";
+    assert(canonicalRegex(ast) == expectedKey);
+}
+
+// OK Check the pre-compilation size estimate against what is actually built
+void checkRegexSize(const std::string &regex)
+{
+    RegexSize size = estimateRegexSize(parseRegex(regex));
+    NFA nfa = regexToNFA(regex);
+    GlushkovNFA glushkov = regexToGlushkov(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    std::cout << "  ## Size of " << regex << ": " << size.nfaStates << " NFA states, " << size.positions
+              << " positions, " << dfa.states.size() << " DFA states (bound " << size.dfaStatesBound << ")\n";
+    assert(size.nfaStates == nfa.stateCount());
+    assert(size.positions == glushkov.positions());
+    assert(dfa.states.size() <= size.dfaStatesBound);
+}
+
+// OK Check that chained counts such as a{2}{2}{2} nest against the parser's
+// limit and are rejected from their size estimate before anything is built
+void checkChainedRepeat()
+{
+    auto chain = [](int links)
+    {
+        std::string regex = "a";
+        for (int i = 0; i < links; ++i)
+            regex += "{2}";
+        return regex;
+    };
+    checkAccepts(chain(3), {"aaaaaaaa"}, {"aaaaaaa", "aaaaaaaaa"});
+
+    bool threw = false;
+    try
+    {
+        parseRegex(chain(1001));
+    }
+    catch (const RegexParseError &e)
+    {
+        threw = std::string(e.what()).find("nested deeper") != std::string::npos;
+    }
+    assert(threw);
+    assert(estimateRegexSize(parseRegex(chain(1000))).nfaStates == UINT64_MAX);
+
+    RegexSize size = estimateRegexSize(parseRegex(chain(30)));
+    std::cout << "  ## a{2} chained 30 times: " << size.nfaStates << " NFA states, DFA bound " << size.dfaBytesBound << " bytes\n";
+    threw = false;
+    try
+    {
+        PatternCache cache;
+        cache.get(chain(30));
+    }
+    catch (const DFABuildError &e)
+    {
+        threw = e.limit == DFABuildError::MaxBytes && e.states == 0;
+    }
+    assert(threw);
+}
+
 // OK Check number of DFA states
 void checkDFAStateCount(const std::string &regex, int expectedMin, int expectedMax)
 {
@@ -51,6 +176,98 @@ void checkMinimizedStateCount(const std::string &regex, int expectedMax)
     assert(min.states.size() <= expectedMax);
 }
 
+// OK Check exact minimal size and that minimization preserves the language
+// on every string over `alphabet` up to maxLen characters
+void checkMinimizedEquivalent(const std::string &regex, const std::string &alphabet, size_t expected, size_t maxLen)
+{
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    DFA min = minimizeDFA(dfa);
+
+    std::cout << "  >> Minimized " << regex << ": " << dfa.states.size() << " -> " << min.states.size()
+              << " states (expected " << expected << ")\n";
+    assert(min.states.size() == expected);
+
+    std::vector<std::string> frontier = {""};
+    for (size_t len = 0; len <= maxLen; ++len)
+    {
+        std::vector<std::string> next;
+        for (const auto &input : frontier)
+        {
+            std::vector<int> t1, t2;
+            assert(simulateDFA(dfa, input, t1) == simulateDFA(min, input, t2));
+            for (char c : alphabet)
+                next.push_back(input + c);
+        }
+        frontier.swap(next);
+    }
+}
+
+// OK Check that the dense table gives the same verdicts and traces as the map-based DFA
+void checkDenseDFA(const std::string &regex, const std::vector<std::string> &inputs)
+{
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    DenseDFA dense = compileDFA(dfa);
+    std::cout << "  ## Dense DFA: " << dense.numStates << " rows (incl. dead state)\n";
+    assert(dense.numStates == dfa.states.size() + 1);
+
+    for (const auto &input : inputs)
+    {
+        std::vector<int> expected, trace;
+        bool result = simulateDFA(dense, input, trace);
+        assert(result == simulateDFA(dfa, input, expected));
+        assert(trace == expected);
+    }
+}
+
+// OK Check compact traces: checkpoints every K steps replay to the full trace
+void checkCompactTrace(const std::string &regex, const std::string &input, uint32_t interval)
+{
+    DenseDFA dense = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))));
+    std::vector<int> full;
+    bool expected = simulateDFA(dense, input, full);
+
+    CompactTrace compact;
+    compact.interval = interval;
+    assert(simulateDFA(dense, input.data(), input.size(), compact) == expected);
+    assert(matchDFA(dense, input) == expected);
+    assert(compact.steps + 1 == full.size());
+    assert(compact.checkpoints.size() == compact.steps / interval + 1);
+    std::cout << "  ## Compact trace " << regex << ": " << full.size() << " states kept as "
+              << compact.checkpoints.size() << " checkpoints\n";
+
+    assert(replayTrace(dense, input.data(), compact, 0, full.size() + 10) == full);
+    for (size_t from = 0; from < full.size(); from += 7)
+        for (size_t to = from; to <= full.size(); to += 5)
+            assert(replayTrace(dense, input.data(), compact, from, to) ==
+                   std::vector<int>(full.begin() + from, full.begin() + to));
+}
+
+// OK Check byte classes: labelled bytes get their own class, the rest share one
+void checkByteClasses(const std::string &regex, int expectedCount)
+{
+    FlatNFA flat = flattenNFA(regexToNFA(regex));
+    ByteClasses classes = computeByteClasses(flat);
+    DenseDFA dense = compileDFA(convertNFAtoDFA(flat));
+    std::cout << "  ## Byte classes for " << regex << ": " << classes.count << ", dense table "
+              << dense.table.size() * sizeof(uint32_t) << " bytes\n";
+
+    assert(classes.count == expectedCount);
+    assert(dense.numClasses == (uint32_t)expectedCount);
+    // Bytes of one class lead from every state to the same targets.
+    for (uint32_t s = 0; s < flat.numStates; ++s)
+    {
+        std::vector<std::set<uint32_t>> targets(256);
+        for (uint32_t e = flat.symOffsets[s]; e < flat.symOffsets[s + 1]; ++e)
+            for (int b = flat.symRanges[e].lo; b <= flat.symRanges[e].hi; ++b)
+                targets[b].insert(flat.symTargets[e]);
+        for (int b = 0; b < 256; ++b)
+            assert(targets[b] == targets[classes.members(classes.classOf[b])[0]]);
+    }
+    assert(classes.classOf[0] == 0);
+}
+
 // OK Check for dead states
 void checkDeadStates(const std::string &regex)
 {
@@ -72,6 +289,635 @@ void checkDeadStates(const std::string &regex)
     }
 }
 
+// OK Check that the NFA arena owns its states in creation order
+void checkArena(const std::string &regex)
+{
+    NFA nfa = regexToNFA(regex);
+    std::cout << "  ## NFA arena: " << nfa.stateCount() << " states, " << nfa.arenaBytes() << " bytes\n";
+
+    assert(nfa.stateCount() > 0);
+    size_t edgeBytes = 0;
+    for (size_t i = 0; i < nfa.stateCount(); ++i)
+        edgeBytes += nfa.arena->at(i)->epsilon.size() * sizeof(State *) +
+                     nfa.arena->at(i)->transitions.size() * sizeof(nfa.arena->at(i)->transitions[0]);
+    assert(nfa.arenaBytes() >= nfa.stateCount() * sizeof(State) + edgeBytes);
+    for (size_t i = 0; i < nfa.stateCount(); ++i)
+        assert(nfa.arena->at(i)->id == (int)i);
+    assert(nfa.arena->at(nfa.start->id) == nfa.start);
+    assert(nfa.arena->at(nfa.accept->id) == nfa.accept);
+}
+
+// OK Check that the CSR form preserves every NFA edge and builds the same DFA
+void checkFlatNFA(const std::string &regex)
+{
+    NFA nfa = regexToNFA(regex);
+    FlatNFA flat = flattenNFA(nfa);
+
+    size_t edges = 0;
+    for (size_t i = 0; i < nfa.stateCount(); ++i)
+    {
+        edges += nfa.arena->at(i)->epsilon.size();
+        edges += nfa.arena->at(i)->transitions.size();
+    }
+
+    std::cout << "  ## Flat NFA: " << flat.numStates << " states, " << edges << " edges\n";
+    assert(flat.numStates == nfa.stateCount());
+    assert(flat.start == (uint32_t)nfa.start->id && flat.accept == (uint32_t)nfa.accept->id);
+    assert(flat.epsOffsets.size() == flat.numStates + 1 && flat.symOffsets.size() == flat.numStates + 1);
+    assert(flat.epsTargets.size() + flat.symTargets.size() == edges);
+
+    DFA fromFlat = convertNFAtoDFA(flat);
+    DFA fromGraph = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    assert(fromFlat.states.size() == fromGraph.states.size());
+    for (const auto &[id, state] : fromFlat.states)
+    {
+        assert(state.isAccept == fromGraph.states.at(id).isAccept);
+        assert(state.transitions == fromGraph.states.at(id).transitions);
+    }
+}
+
+// OK Check range transitions: one NFA edge per run of bytes, and DFA ranges that
+// are sorted, disjoint, maximal and agree with the dense table on every byte
+void checkRangeTransitions(const std::string &regex, size_t expectedNfaEdges, size_t expectedDfaRanges)
+{
+    NFA nfa = regexToNFA(regex);
+    size_t nfaEdges = 0;
+    for (size_t i = 0; i < nfa.stateCount(); ++i)
+        nfaEdges += nfa.arena->at(i)->transitions.size();
+
+    DFA dfa = minimizeDFA(convertNFAtoDFA(flattenNFA(nfa)));
+    DenseDFA dense = compileDFA(dfa);
+    size_t dfaRanges = 0;
+    for (uint32_t s = 0; s < dense.dead; ++s)
+    {
+        const DFAState &state = dfa.states.at(dense.stateIds[s]);
+        const auto &ranges = state.transitions;
+        dfaRanges += ranges.size();
+        for (size_t t = 0; t < ranges.size(); ++t)
+        {
+            assert(ranges[t].first.lo <= ranges[t].first.hi);
+            if (t > 0)
+            {
+                assert(ranges[t - 1].first.hi < ranges[t].first.lo);
+                assert(ranges[t - 1].first.hi + 1 < ranges[t].first.lo || ranges[t - 1].second != ranges[t].second);
+            }
+        }
+        for (int b = 0; b < 256; ++b)
+        {
+            int next = state.next(static_cast<unsigned char>(b));
+            uint32_t target = dense.table[s * dense.numClasses + dense.classOf[b]];
+            assert(next == -1 ? target == dense.dead : dense.stateIds[target] == next);
+        }
+    }
+
+    std::cout << "  ## Ranges for " << regex << ": " << nfaEdges << " NFA symbol edges, " << dfaRanges
+              << " DFA ranges\n";
+    assert(nfaEdges == expectedNfaEdges);
+    assert(dfaRanges == expectedDfaRanges);
+}
+
+// OK Check precomputed ε-closures against a plain BFS from every state
+void checkEpsilonClosures(const std::string &regex)
+{
+    FlatNFA flat = flattenNFA(regexToNFA(regex));
+    EpsilonClosures closures = computeEpsilonClosures(flat);
+    std::cout << "  ## ε-closures: " << flat.numStates << " states in " << closures.components() << " components\n";
+
+    for (uint32_t s = 0; s < flat.numStates; ++s)
+    {
+        StateSet expected(flat.numStates);
+        std::vector<uint32_t> stack = {s};
+        expected.insert(s);
+        while (!stack.empty())
+        {
+            uint32_t curr = stack.back();
+            stack.pop_back();
+            for (uint32_t e = flat.epsOffsets[curr]; e < flat.epsOffsets[curr + 1]; ++e)
+            {
+                if (!expected.contains(flat.epsTargets[e]))
+                {
+                    expected.insert(flat.epsTargets[e]);
+                    stack.push_back(flat.epsTargets[e]);
+                }
+            }
+        }
+        assert(closures.of(s) == expected);
+    }
+}
+
+// OK Check that the ε-closure table counts against max_bytes in every build path
+void checkClosureLimits()
+{
+    FlatNFA flat = flattenNFA(regexToNFA("((a*b*)*|c)*"));
+    EpsilonClosures full = computeEpsilonClosures(flat);
+    assert(!full.truncated);
+    assert(computeEpsilonClosures(flat, full.bytes()).truncated == false);
+    assert(computeEpsilonClosures(flat, full.bytes() - 1).truncated);
+
+    bool threw = false;
+    try
+    {
+        LazyDFAOptions options;
+        options.maxClosureBytes = full.bytes() / 2;
+        LazyDFA lazy(flat, options);
+    }
+    catch (const DFABuildError &e)
+    {
+        threw = e.limit == DFABuildError::MaxBytes && e.states == 0;
+    }
+    assert(threw);
+
+    // Passes the NFA size precheck but must still be rejected without
+    // building the whole closure table or DFA.
+    auto started = std::chrono::steady_clock::now();
+    DFABuildOptions limits;
+    limits.maxBytes = 64 << 20;
+    threw = false;
+    try
+    {
+        compilePattern("(a{1000}){200}", limits);
+    }
+    catch (const DFABuildError &e)
+    {
+        threw = e.limit == DFABuildError::MaxBytes;
+    }
+    assert(threw);
+    nlohmann::json strict = handleServeRequest({{"op", "simulate"}, {"regex", "(a{1000}){200}"}, {"input", "a"}, {"max_bytes", 64 << 20}, {"fallback", false}});
+    assert(strict["status"] == "error" && strict["limit"] == "max_bytes");
+    nlohmann::json lazy = handleServeRequest({{"op", "simulate"}, {"regex", "(a{1000}){200}"}, {"input", "a"}, {"max_bytes", 64 << 20}});
+    assert(lazy["status"] == "ok" && lazy["accepted"] == false);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "  ## (a{1000}){200} under 64 MB rejected in " << seconds << " s\n";
+    assert(seconds < 10);
+}
+
+// OK Check that the lazy DFA agrees with the eager one, including under a tiny cache
+void checkLazyDFA(const std::string &regex, const std::vector<std::string> &inputs, size_t memoryBudget)
+{
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(flattenNFA(nfa));
+
+    LazyDFAOptions options;
+    options.memoryBudget = memoryBudget;
+    options.maxCacheClears = 2;
+    LazyDFA lazy(flattenNFA(nfa), options);
+
+    for (const auto &input : inputs)
+    {
+        std::vector<int> trace;
+        bool expected = simulateDFA(dfa, input, trace);
+        bool result = lazy.match(input);
+        std::cout << "  [OK] Lazy test: \"" << input << "\" => " << (result == expected ? "Passed" : "[X] Failed")
+                  << (lazy.stats().fellBack ? " (NFA fallback)" : "") << "\n";
+        assert(result == expected);
+    }
+    std::cout << "  ## Lazy DFA: " << lazy.stats().statesBuilt << " states built, "
+              << lazy.stats().cacheClears << " cache clears\n";
+
+    // A budget that holds exactly the states these inputs reach never clears:
+    // edges into states already cached cost nothing.
+    LazyDFA roomy(flattenNFA(nfa));
+    for (const auto &input : inputs)
+        roomy.match(input);
+    if (roomy.stats().cacheClears == 0)
+    {
+        options.memoryBudget = roomy.stats().cacheBytes;
+        LazyDFA exact(flattenNFA(nfa), options);
+        for (const auto &input : inputs)
+            exact.match(input);
+        assert(exact.stats().cacheClears == 0 && exact.stats().statesBuilt == roomy.stats().statesBuilt);
+    }
+}
+
+// OK Check LRU pattern cache: canonical keys, counters, eviction and sharing across threads
+void checkPatternCache()
+{
+    PatternCache cache(1 << 20);
+    auto first = cache.get("(a|b)*abb");
+    auto second = cache.get("((a|b)*abb)"); // same postfix form
+    assert(first == second);
+    assert(cache.stats().hits == 1 && cache.stats().misses == 1);
+
+    PatternCache tiny(first->bytes + 1);
+    auto kept = tiny.get("(a|b)*abb");
+    tiny.get("a*");
+    tiny.get("(a|(b|c)*)d");
+    PatternCacheStats stats = tiny.stats();
+    std::cout << "  ## Pattern cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions, " << stats.entries << " entries\n";
+    assert(stats.evictions >= 1 && stats.entries < 3);
+    std::vector<int> trace;
+    assert(simulateDFA(kept->dense, "aabb", trace)); // evicted patterns stay alive for holders
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&cache]
+                             {
+            for (int i = 0; i < 100; ++i)
+                cache.get(i % 2 ? "(a|b)*abb" : "a*b*"); });
+    for (auto &thread : threads)
+        thread.join();
+    assert(cache.stats().hits + cache.stats().misses == 402);
+    assert(cache.stats().entries == 2);
+}
+
+// OK Check the parallel file pipeline keeps line order and matches sequential simulation
+void checkBatch(const std::string &regex, unsigned threads, size_t chunkBytes)
+{
+    DenseDFA dfa = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))));
+    std::string input, expected;
+    for (int i = 0; i < 500; ++i)
+    {
+        std::string line;
+        for (int j = 0; j < i % 13; ++j)
+            line += "abc"[(i * 7 + j * 3) % 3];
+        input += line + "\n";
+
+        std::vector<int> trace;
+        bool accepted = simulateDFA(dfa, line, trace);
+        expected += "Input: \"" + line + "\" => ";
+        for (size_t t = 0; t < trace.size(); ++t)
+            expected += std::to_string(trace[t]) + (t + 1 < trace.size() ? " -> " : "");
+        expected += accepted ? " => [OK] Accepted\n" : " => [X] Rejected\n";
+    }
+    input += "abb"; // last line without a newline
+    expected += "Input: \"abb\" => 0 -> 1 -> 3 -> 4 => [OK] Accepted\n";
+
+    BatchOptions options;
+    options.threads = threads;
+    options.chunkBytes = chunkBytes;
+    std::istringstream in(input);
+    std::ostringstream out;
+    BatchStats stats = runBatch(dfa, in, out, options);
+
+    std::cout << "  ## Batch: " << stats.lines << " lines on " << threads << " threads, " << chunkBytes << "-byte chunks\n";
+    assert(stats.lines == 501 && stats.bytes == input.size());
+    assert(out.str() == expected);
+
+    // Zero-copy path over an in-memory buffer
+    std::ostringstream spanOut;
+    BatchStats spanStats = runBatch(dfa, input.data(), input.size(), spanOut, options);
+    assert(spanStats.lines == 501 && spanStats.bytes == input.size());
+    assert(spanOut.str() == expected);
+
+    // Verdict-only mode
+    std::string verdicts;
+    for (size_t pos = 0; pos < expected.size();)
+    {
+        size_t eol = expected.find('\n', pos);
+        std::string line = expected.substr(pos, eol - pos);
+        size_t arrow = line.find("\" => ");
+        verdicts += line.substr(0, arrow + 5) + line.substr(line.rfind(" => ") + 4) + "\n";
+        pos = eol + 1;
+    }
+    options.traces = false;
+    std::ostringstream verdictOut;
+    runBatch(dfa, input.data(), input.size(), verdictOut, options);
+    assert(verdictOut.str() == verdicts);
+    options.simdLanes = true;
+    std::ostringstream laneOut;
+    runBatch(dfa, input.data(), input.size(), laneOut, options);
+    assert(laneOut.str() == verdicts);
+    options.simdLanes = false;
+
+    // Prefiltered verdicts: same output, only lines holding the literal reach the DFA
+    options.prefilter = requiredLiteral(regex);
+    size_t expectedHits = 0;
+    std::istringstream lines(input);
+    for (std::string line; std::getline(lines, line);)
+        expectedHits += line.find(options.prefilter) != std::string::npos;
+    std::ostringstream filteredOut;
+    BatchStats filtered = runBatch(dfa, input.data(), input.size(), filteredOut, options);
+    assert(filteredOut.str() == verdicts);
+    assert(filtered.prefilterHits == (options.prefilter.empty() ? 0 : expectedHits));
+
+    // A literal spanning a newline only screens on its first line's part
+    BatchOptions spanning;
+    spanning.traces = false;
+    spanning.prefilter = requiredLiteral("a\\nb");
+    assert(spanning.prefilter == "a\nb");
+    std::ostringstream spanningOut;
+    BatchStats spanningStats = runBatch(compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA("a\\nb")))), "a\nab\nb", 6, spanningOut, spanning);
+    assert(spanningStats.lines == 3 && spanningStats.prefilterHits == 2);
+}
+
+// OK Check that a mapped file exposes exactly the bytes written
+void checkMappedFile()
+{
+    std::string path = "mapped_file_test.txt";
+    std::string contents = "(a|b)*abb\nabb\n\nbab";
+    std::ofstream(path, std::ios::binary) << contents;
+    {
+        MappedFile file(path);
+        assert(file.ok() && file.size() == contents.size());
+        assert(std::string(file.data(), file.size()) == contents);
+    }
+    std::remove(path.c_str());
+    assert(!MappedFile(path).ok());
+}
+
+// OK Check the literal every match must contain
+void checkRequiredLiteral(const std::string &regex, const std::string &expected)
+{
+    std::string literal = requiredLiteral(regex);
+    std::cout << "  ## Required literal of " << regex << ": \"" << literal << "\"\n";
+    assert(literal == expected);
+}
+
+// OK Check the dispatched literal scan against std::string::find
+void checkFindLiteral()
+{
+    std::string text;
+    for (int i = 0; i < 400; ++i)
+        text += "abcab"[(i * 7 + i / 5) % 5];
+    text += "abbxabb";
+    for (const std::string literal : {"a", "abb", "bca", "abbxabb", "zz", "cabcab"})
+        for (size_t begin = 0; begin < text.size(); begin += 3)
+        {
+            size_t expected = text.find(literal, begin);
+            const char *hit = findLiteral(text.data() + begin, text.data() + text.size(), literal);
+            assert(static_cast<size_t>(hit - text.data()) == (expected == std::string::npos ? text.size() : expected));
+        }
+}
+
+// OK Check the dispatched newline scan against memchr at every offset
+void checkFindNewline()
+{
+    std::string buffer(300, 'x');
+    for (size_t i = 0; i < buffer.size(); i += 37)
+        buffer[i + 5] = '\n';
+    for (size_t begin = 0; begin < buffer.size(); ++begin)
+    {
+        const char *b = buffer.data() + begin, *e = buffer.data() + buffer.size();
+        const void *expected = memchr(b, '\n', e - b);
+        assert(findNewline(b, e) == (expected ? expected : e));
+    }
+    std::cout << "  ## findNewline dispatch: " << simdLevel() << "\n";
+}
+
+// OK Check SIMD lane classification against the dense DFA on many lines
+void checkShuffleDFA(const std::string &regex, const std::string &alphabet)
+{
+    DenseDFA dense = compileDFA(minimizeDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex)))));
+    ShuffleDFA shuffle = compileShuffleDFA(dense);
+    assert(shuffle.usable);
+
+    std::string text;
+    std::vector<uint8_t> expected;
+    uint32_t seed = 7;
+    for (int i = 0; i < 200; ++i)
+    {
+        std::string line;
+        seed = seed * 1103515245 + 12345;
+        for (uint32_t j = 0; j < (seed >> 16) % 20; ++j)
+        {
+            seed = seed * 1103515245 + 12345;
+            line += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        std::vector<int> trace;
+        expected.push_back(simulateDFA(dense, line, trace));
+        text += line + "\n";
+    }
+
+    std::vector<uint8_t> verdicts;
+    classifyLines(shuffle, text.data(), text.size(), verdicts);
+    size_t accepted = 0;
+    for (uint8_t v : verdicts)
+        accepted += v;
+    std::cout << "  ## Shuffle DFA " << regex << ": " << dense.numStates << " states, "
+              << accepted << "/" << verdicts.size() << " lines accepted\n";
+    assert(verdicts == expected);
+}
+
+// OK Check the reversed NFA accepts exactly the reversed strings
+void checkReverseNFA(const std::string &regex, const std::vector<std::string> &inputs)
+{
+    FlatNFA flat = flattenNFA(regexToNFA(regex));
+    DenseDFA forward = compileDFA(convertNFAtoDFA(flat));
+    DenseDFA reverse = compileDFA(convertNFAtoDFA(reverseNFA(flat)));
+    for (const auto &input : inputs)
+        assert(matchDFA(forward, input) == matchDFA(reverse, std::string(input.rbegin(), input.rend())));
+}
+
+// OK Check search and find-all against a brute-force leftmost-longest scan
+void checkSearch(const std::string &regex, const std::string &text)
+{
+    DenseDFA anchored = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))));
+    std::vector<Match> expected;
+    for (size_t pos = 0; pos <= text.size();)
+    {
+        bool found = false;
+        for (size_t start = pos; start <= text.size() && !found; ++start)
+            for (size_t end = text.size() + 1; end-- > start;)
+                if (matchDFA(anchored, text.data() + start, end - start))
+                {
+                    if (end == start && !expected.empty() && expected.back().end == start)
+                        break;
+                    expected.push_back({start, end});
+                    pos = end > start ? end : start + 1;
+                    found = true;
+                    break;
+                }
+        if (!found)
+            break;
+    }
+
+    Searcher searcher(flattenNFA(regexToNFA(regex)));
+    std::vector<Match> matches = searcher.findAll(text.data(), text.size());
+    std::cout << "  ## Search " << regex << " in \"" << text << "\": " << matches.size() << " matches\n";
+    assert(matches.size() == expected.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+        assert(matches[i].start == expected[i].start && matches[i].end == expected[i].end);
+
+    Match first;
+    assert(searcher.occurs(text.data(), text.size()) == !expected.empty());
+    assert(searcher.find(text.data(), text.size(), first) == !expected.empty());
+    if (!expected.empty())
+        assert(first.start == expected[0].start && first.end == expected[0].end);
+}
+
+// OK Check a pattern set reports exactly the patterns that match on their own
+void checkPatternSet(const std::vector<std::string> &regexes, const std::vector<std::string> &inputs, size_t expectedStates)
+{
+    PatternSet set = compilePatternSet(regexes);
+    std::vector<FlatNFA> nfas;
+    for (const auto &regex : regexes)
+        nfas.push_back(flattenNFA(regexToNFA(regex)));
+    DenseDFA unminimized = compileDFA(convertNFAtoDFA(unionNFAs(nfas)));
+    std::cout << "  ## Pattern set of " << regexes.size() << ": " << set.dfa.states.size() << " minimized states\n";
+    if (expectedStates)
+        assert(set.dfa.states.size() == expectedStates);
+
+    for (const auto &input : inputs)
+    {
+        std::vector<int> expected;
+        for (size_t i = 0; i < regexes.size(); ++i)
+            if (matchDFA(compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regexes[i])))), input))
+                expected.push_back(static_cast<int>(i));
+        assert(set.match(input) == expected);
+        assert(matchingPatterns(unminimized, input.data(), input.size()) == expected);
+    }
+}
+
+// OK Check the Glushkov automaton and its bit-parallel simulation against the DFA
+void checkShiftAnd(const std::string &regex, size_t expectedPositions, const std::string &alphabet)
+{
+    GlushkovNFA glushkov = regexToGlushkov(regex);
+    std::cout << "  ## Glushkov " << regex << ": " << glushkov.positions() << " positions\n";
+    assert(glushkov.positions() == expectedPositions);
+    assert(ShiftAndMatcher::fits(glushkov));
+
+    ShiftAndMatcher matcher(glushkov);
+    DenseDFA dfa = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA(regex))));
+    uint32_t seed = 99;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string input;
+        seed = seed * 1103515245 + 12345;
+        for (uint32_t j = 0; j < (seed >> 16) % 12; ++j)
+        {
+            seed = seed * 1103515245 + 12345;
+            input += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        assert(matcher.match(input) == matchDFA(dfa, input));
+    }
+}
+
+// OK Check the Pike VM against the DFA on random inputs
+void checkPikeVM(const std::string &regex, const std::string &alphabet)
+{
+    FlatNFA flat = flattenNFA(regexToNFA(regex));
+    PikeProgram program = compilePikeProgram(flat);
+    size_t matches = 0;
+    for (const PikeInst &inst : program.code)
+        matches += inst.op == PikeInst::Match;
+    assert(matches == 1);
+
+    PikeVM vm(flat);
+    DenseDFA dfa = compileDFA(convertNFAtoDFA(flat));
+    std::cout << "  ## Pike VM " << regex << ": " << vm.programSize() << " instructions\n";
+    uint32_t seed = 5;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string input;
+        seed = seed * 1103515245 + 12345;
+        for (uint32_t j = 0; j < (seed >> 16) % 14; ++j)
+        {
+            seed = seed * 1103515245 + 12345;
+            input += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        assert(vm.match(input) == matchDFA(dfa, input));
+    }
+}
+
+// OK Check DFA build limits abort early, hold on cache hits and fall back in serve mode
+void checkBuildLimits(const std::string &regex, size_t maxStates)
+{
+    FlatNFA flat = flattenNFA(regexToNFA(regex));
+    size_t fullStates = convertNFAtoDFA(flat).states.size();
+    assert(fullStates > maxStates);
+
+    DFABuildOptions limits;
+    limits.maxStates = maxStates;
+    try
+    {
+        convertNFAtoDFA(flat, limits);
+        assert(false);
+    }
+    catch (const DFABuildError &e)
+    {
+        std::cout << "  ## Limit: " << e.what() << "\n";
+        assert(e.limit == DFABuildError::MaxStates && e.states == maxStates + 1);
+    }
+
+    limits = DFABuildOptions();
+    limits.maxBytes = 2048;
+    try
+    {
+        convertNFAtoDFA(flat, limits);
+        assert(false);
+    }
+    catch (const DFABuildError &e)
+    {
+        assert(e.limit == DFABuildError::MaxBytes && e.bytes > 2048 && e.states < fullStates);
+    }
+
+    limits.maxStates = fullStates;
+    limits.maxBytes = 0;
+    assert(convertNFAtoDFA(flat, limits).states.size() == fullStates);
+
+    // Cached patterns obey the limits of each request.
+    PatternCache cache;
+    cache.get(regex);
+    limits.maxStates = maxStates;
+    bool threw = false;
+    try
+    {
+        cache.get(regex, limits);
+    }
+    catch (const DFABuildError &)
+    {
+        threw = true;
+    }
+    assert(threw);
+
+    // max_bytes right at the bytes a fresh build charges: a cold and a warm
+    // request agree on either side of it.
+    size_t buildBytes = compilePattern(regex)->dfaBytes;
+    for (size_t maxBytes : {buildBytes - 1, buildBytes})
+    {
+        limits = DFABuildOptions();
+        limits.maxBytes = maxBytes;
+        auto outcome = [&](PatternCache &c)
+        {
+            try
+            {
+                c.get(regex, limits);
+                return true;
+            }
+            catch (const DFABuildError &)
+            {
+                return false;
+            }
+        };
+        PatternCache cold;
+        bool coldBuilt = outcome(cold);
+        PatternCache warm;
+        warm.get(regex, DFABuildOptions());
+        assert(outcome(warm) == coldBuilt && coldBuilt == (maxBytes == buildBytes));
+    }
+
+    std::string input = "abababbbabaaab";
+    DenseDFA dense = compileDFA(convertNFAtoDFA(flat));
+    nlohmann::json fallback = handleServeRequest({{"op", "simulate"}, {"regex", regex}, {"input", input}, {"max_states", maxStates}});
+    assert(fallback["status"] == "ok" && fallback["engine"] != "dfa");
+    assert(fallback["accepted"] == matchDFA(dense, input));
+    assert(fallback["fallback"]["limit"] == "max_states");
+
+    nlohmann::json strict = handleServeRequest({{"op", "simulate"}, {"regex", regex}, {"input", input}, {"max_states", maxStates}, {"fallback", false}});
+    assert(strict["status"] == "error" && strict["limit"] == "max_states" && strict["max_states"] == maxStates);
+}
+
+// OK Check serve-mode requests against the one-shot DFA path
+void checkServeRequest(const std::string &regex, const std::string &input, bool minimized)
+{
+    nlohmann::json response = handleServeRequest({{"op", "simulate"}, {"regex", regex}, {"input", input}, {"minimized", minimized}});
+    NFA nfa = regexToNFA(regex);
+    DFA dfa = convertNFAtoDFA(nfa.start, nfa.accept->id);
+    if (minimized)
+        dfa = minimizeDFA(dfa);
+    std::vector<int> trace;
+    bool expected = simulateDFA(dfa, input, trace);
+
+    std::cout << "  [OK] Serve test: " << response.dump() << "\n";
+    assert(response["status"] == "ok");
+    assert(response["accepted"] == expected);
+    assert(response["trace"].get<std::vector<int>>() == trace);
+
+    nlohmann::json bare = handleServeRequest({{"op", "simulate"}, {"regex", regex}, {"input", input}, {"minimized", minimized}, {"trace", false}});
+    assert(bare["accepted"] == expected && !bare.contains("trace"));
+}
+
 int main()
 {
     std::cout << "===== [OK] Starting Enhanced Tests =====\n\n";
@@ -89,6 +935,86 @@ int main()
                  {"a", "b"},
                  {"ab", "", "ba"});
 
+    // OK Parser: empty branches, printable literals, errors with positions
+    checkAccepts("", {""}, {"a"});
+    checkAccepts("a|", {"a", ""}, {"b", "aa"});
+    checkAccepts("a()b", {"ab"}, {"a", "b", ""});
+    checkAccepts("x-y z", {"x-y z"}, {"x-y", "xy z"});
+    checkRegexAST("(a|b)*abb", "ab|*a.b.b.");
+    checkRegexAST("((a|b)*abb)", "ab|*a.b.b.");
+    checkRegexAST("a|b|c", "ab|c|");
+    checkRegexAST("", "()");
+    checkRegexAST("(a|)-", "a()|\\-.");
+    checkParseError("(ab", 0);
+    checkParseError("a(b(c)", 1);
+    checkParseError("ab)", 2);
+    checkParseError("(a))b", 3);
+    checkParseError("*a", 0);
+    checkParseError("a|*", 2);
+    checkParseError("(*)", 1);
+    checkParseError("a{2", 1);
+    checkParseError("a{,2}", 2);
+    checkParseError("a{3,2}", 1);
+    checkParseError("a{1001}", 1);
+    checkParseError("{2}", 0);
+    checkParseError("+a", 0);
+    checkParseError("x[abc", 1);
+    checkParseError("[z-a]", 1);
+    checkParseError("[\\d-z]", 1);
+    checkParseError("a\\", 1);
+    checkParseError("\\q", 0);
+    checkParseError("ab\\x4", 2);
+    checkParseError(std::string("a\0b", 3), 1);
+    checkParseError("ab\xc3", 2);
+    checkParseError("ab\xff", 2);
+    checkParseError("\xc0\x80", 0);
+    checkParseError("x\xed\xa0\x80", 1);
+    checkParseError("[a\xc3\xa9]", 2);
+    checkParseError("[\\u00e9]", 1);
+    checkParseError("(?u)\\u{110000}", 4);
+    checkParseError("\\ud800", 0);
+    checkParseError(std::string(2000, '('), 1000);
+    assert(requiredLiteral("") == "" && requiredLiteral("a()b") == "ab");
+
+    // OK Extended syntax: + ? . classes, ranges and escapes as byte sets
+    checkAccepts("[0-9]+", {"0", "123"}, {"", "a1", "1a"});
+    checkAccepts("a?b+", {"b", "ab", "abbb"}, {"", "a", "aab", "ba"});
+    checkAccepts("\\d\\d-\\w+", {"12-a_b", "00-Z"}, {"1-a", "12-", "12-a-"});
+    checkAccepts(".\\.[a\\-z]", {"x.-", "..z", "\t.a"}, {"xx-", "\n.a", "x.b"});
+    checkAccepts("[]a]+", {"]", "a]a"}, {"", "b"});
+    checkAccepts("[-a][a-]", {"-a", "a-", "--"}, {"ab", "-"});
+    checkAccepts("[^a-c\\s]\\S", {"dd", "zz"}, {"ad", "d ", " d"});
+    checkAccepts("\\x41\\(", {"A("}, {"A", "a("});
+    {
+        std::string nul("\0", 1);
+        DenseDFA any = compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA("[^a]x\\0"))));
+        assert(matchDFA(any, nul + "x" + nul) && matchDFA(any, "\xffx" + nul) && !matchDFA(any, "ax" + nul));
+    }
+    checkRegexAST("[a-c]x+\\.?", "[a-c]x+.\\.?.");
+    checkRegexAST("[ca-b]|[\\x61-\\x63]", "[a-c][a-c]|");
+    assert(regexToNFA("[a-z]").stateCount() == 2 && regexToNFA("\\w+").stateCount() == 3);
+    // OK Counted repetition
+    checkAccepts("a{3}", {"aaa"}, {"aa", "aaaa"});
+    checkAccepts("(ab){2,3}", {"abab", "ababab"}, {"ab", "abababab", "aba"});
+    checkAccepts("[0-9]{2,}", {"12", "12345"}, {"1", "", "12a"});
+    checkAccepts("x{0}y", {"y"}, {"xy", ""});
+    checkAccepts("(a|b){0,2}c", {"c", "ac", "bac"}, {"abac", "a"});
+    checkAccepts("(a{2}|b){2}", {"aaaa", "aab", "bb", "baa"}, {"ab", "aaa", "b"});
+    checkRegexAST("a{2,3}", "a{2,3}");
+    checkRegexAST("(ab){2,}c", "ab.{2,}c.");
+    checkRegexAST("a{0,}b{1,}c{0,1}(de){1}", "a*b+.c?.de..");
+    checkRegexAST("x{0}y", "()y.");
+    checkRegexSize("a{3}");
+    checkRegexSize("(ab|c){2,5}d");
+    checkRegexSize("(a{2,}|b?){3}");
+    checkRegexSize("(a|b)*a(a|b){3}");
+    checkRegexSize("[a-z]+x{0,2}");
+    assert(estimateRegexSize(parseRegex("(a{1000}){1000}")).nfaStates == 2000000);
+    checkChainedRepeat();
+    assert(requiredLiteral("x(ab){3}y") == "xabababy" && requiredLiteral("(ab){2,}c") == "abab" &&
+           requiredLiteral("a{0,3}b") == "b" && requiredLiteral("(abc){9}") == "abcabcabcabc");
+    assert(requiredLiteral("x[0-9]+yz") == "yz" && requiredLiteral("(ab)+c") == "abc" && requiredLiteral("(ab)?c") == "c");
+
     // OK DFA State Count Range Checks
     checkDFAStateCount("(a|b)*abb", 4, 15);
     checkDFAStateCount("a*", 2, 5);
@@ -99,10 +1025,179 @@ int main()
     checkDeadStates("a*");
     checkDeadStates("a|b");
 
+    // OK Arena ownership
+    checkArena("(a|b)*abb");
+    checkArena("((a|b)*(c|d)*)*e");
+
+    // OK CSR layout
+    checkFlatNFA("(a|b)*abb");
+    checkFlatNFA("(a|(b|c)*)d");
+
+    // OK ε-closure table
+    checkEpsilonClosures("(a|b)*abb");
+    checkEpsilonClosures("((a*b*)*|c)*");
+
+    // OK Dense transition table
+    checkDenseDFA("(a|b)*abb", {"abb", "aabb", "ab", "", "abc", "bcbc", "babb"});
+    checkDenseDFA("(a|(b|c)*)d", {"d", "ad", "bcbd", "abd", "a", "dd"});
+
+    // OK Accept-only matching and checkpointed traces
+    checkCompactTrace("(a|b)*abb", "abababbbabababaabbababbabbaabababbabb", 4);
+    checkCompactTrace("(a|b)*abb", "ababab", 8);
+    checkCompactTrace("(a|b)*abb", "abacab", 2);
+    checkCompactTrace("(a|b)*abb", "", 3);
+    checkCompactTrace("(a|(b|c)*)d", "bcbcbcbcbcbcbcbd", 1);
+
+    // OK Byte equivalence classes
+    checkByteClasses("(a|b)*abb", 3);
+    checkByteClasses("(a|(b|c)*)d", 5);
+    checkByteClasses("a*", 2);
+    checkByteClasses("[a-z]+[0-9]", 3);
+    checkByteClasses(".*x", 3);
+
+    // OK UTF-8 literals and (?u) codepoint classes
+    checkAccepts("\xc3\xa9+", {"\xc3\xa9", "\xc3\xa9\xc3\xa9"}, {"\xc3", "e", "\xc3\xa9\xa9"});
+    checkAccepts("caf\\u{e9}|\\u00e8", {"caf\xc3\xa9", "\xc3\xa8"}, {"cafe", "caf\xe9"});
+    checkAccepts(".", {"\xff", "a"}, {"\xc3\xa9", "\n"});
+    checkAccepts("(?u).", {"a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"}, {"\xff", "\xc3", "\n", "ab"});
+    checkAccepts("(?u)[\xce\xb1-\xcf\x89]+", {"\xce\xb1\xce\xb2\xcf\x89"}, {"a", "\xce", "\xce\xb1" "a"});
+    checkAccepts("(?u)\\xe9\\W", {"\xc3\xa9\xe2\x82\xac", "\xc3\xa9 "}, {"\xe9 ", "\xc3\xa9" "a"});
+    checkAccepts("(?u)[^\\x00-\\x7f]+", {"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"}, {"\xc3\xa9" "a", "\xed\xa0\x80"});
+    checkUtf8Class("(?u).", [](uint32_t cp)
+                   { return cp != '\n'; });
+    checkUtf8Class("(?u)[\xce\xb1-\xcf\x89\\u20ac-\\u20bf]", [](uint32_t cp)
+                   { return (cp >= 0x3b1 && cp <= 0x3c9) || (cp >= 0x20ac && cp <= 0x20bf); });
+    checkUtf8Class("(?u)[^\\x00-\\x7f]", [](uint32_t cp)
+                   { return cp >= 0x80; });
+    checkUtf8Class("(?u)[a\\u{10000}-\\u{10ffff}]", [](uint32_t cp)
+                   { return cp == 'a' || cp >= 0x10000; });
+    checkRegexAST("(?u)[\xce\xb1-\xcf\x89]\xc3\xa9", "<3b1-3c9,>\\\xc3\\\xa9..");
+    checkRegexSize("(?u).");
+    checkRegexSize("(?u)[\xce\xb1-\xcf\x89\\u20ac]{2}x");
+    checkShiftAnd("(?u)[\xce\xb1-\xcf\x89]+x", 5, "x\xce\xb1\xb2\xcf\x89");
+    checkPikeVM("(?u)[^a]+a", "a\xce\xb1\xc3\xff");
+    checkRangeTransitions("(?u).", 17, 17);
+
+    // OK Range-labelled transitions
+    checkRangeTransitions("[a-z]+", 1, 2);
+    checkRangeTransitions(".*", 2, 2);
+    checkRangeTransitions("[a-z]*[0-9a-f]", 3, 6);
+    checkRangeTransitions("\\w+@\\w+", 9, 17);
+
+    // OK Lazy DFA with a roomy cache and with one that thrashes
+    checkLazyDFA("(a|b)*abb", {"abb", "aabb", "babb", "ab", "", "abc"}, 1 << 20);
+    checkLazyDFA("(a|b)*a(a|b)(a|b)(a|b)(a|b)",
+                 {"abbbb", "babababbbbaaab", "bbbbb", "aaaabbbbabbbbbbaaaa", "a"}, 4 * 1024);
+
+    // OK Pattern cache
+    checkPatternCache();
+
+    // OK Parallel file pipeline
+    checkBatch("(a|b)*abb", 1, 1 << 20);
+    checkBatch("(a|b)*abb", 4, 64);
+    checkBatch("(a|b)*abb", 3, 5); // chunks shorter than some lines
+    checkMappedFile();
+
+    // OK Unanchored search with leftmost-longest matches
+    checkReverseNFA("(a|b)*abb", {"abb", "bba", "aabb", "", "ab"});
+    checkReverseNFA("(a|(b|c)*)d", {"d", "ad", "da", "bcbd", "dbcb"});
+    checkSearch("(a|b)*abb", "xxabbabbyaabbz");
+    checkSearch("abcd|c", "abcdxcabc");
+    checkSearch("a*", "baaab");
+    checkSearch("(ab|ba)*|c", "abbaxcabab");
+    checkSearch("(a|b)*abb", "ababab");
+    checkSearch("x", "");
+
+    // OK Pattern sets: one DFA, accept labels kept apart by minimization
+    checkPatternSet({"a", "b"}, {"a", "b", "", "ab"}, 3);
+    checkPatternSet({"a|b", "b|a"}, {"a", "b", "c"}, 2);
+    checkPatternSet({"(a|b)*abb", "(a|b)*", "a*", "(ab|ba)*|c", "abb"},
+                    {"", "a", "aa", "abb", "aabb", "abab", "c", "ba", "babb"}, 0);
+    checkPatternSet({}, {"", "a"}, 1);
+
+    // OK Glushkov construction and Shift-And engine
+    checkShiftAnd("(a|b)*abb", 5, "abc");
+    checkShiftAnd("(a|(b|c)*)d", 4, "abcd");
+    checkShiftAnd("(ab|ba)*|c", 5, "abc");
+    checkShiftAnd("a*", 1, "ab");
+    checkShiftAnd("[ab]+c?", 2, "abc");
+    checkShiftAnd("(a|b)?[^a]+a", 4, "abc");
+    checkShiftAnd("(a|b){2,4}c", 9, "abc");
+    checkShiftAnd("(ab){2,}", 4, "ab");
+    checkShiftAnd("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", 31, "ab");
+    {
+        std::string big;
+        for (int i = 0; i < 64; ++i)
+            big += 'a';
+        assert(!ShiftAndMatcher::fits(regexToGlushkov(big)));
+    }
+
+    // OK Pike VM
+    checkPikeVM("(a|b)*abb", "abc");
+    checkPikeVM("(a|(b|c)*)d", "abcd");
+    checkPikeVM("(ab|ba)*|c", "abc");
+    checkPikeVM("(a*)*b", "ab");
+    checkPikeVM("a*", "ab");
+    checkPikeVM("(a|b)?[ab]+b", "abc");
+    checkPikeVM("(ab|a){1,3}b", "ab");
+
+    // OK Required-literal prefilter
+    checkRequiredLiteral("(a|b)*abb", "abb");
+    checkRequiredLiteral("x(a|b)*yz", "yz");
+    checkRequiredLiteral("abc|abd", "ab");
+    checkRequiredLiteral("abcd|c", "c");
+    checkRequiredLiteral("(xaby|zabw)c", "ab");
+    checkRequiredLiteral("(ab|ba)*|c", "");
+    checkRequiredLiteral("a*", "");
+    checkFindLiteral();
+
+    // OK SIMD newline scan and PSHUFB lanes
+    checkFindNewline();
+    checkShuffleDFA("(a|b)*abb", "abc");
+    checkShuffleDFA("(a|b)*a(a|b)(a|b)", "ab");
+    checkShuffleDFA("(ab|ba)*|c", "abcd");
+    assert(!compileShuffleDFA(compileDFA(convertNFAtoDFA(flattenNFA(regexToNFA("(a|b)*a(a|b)(a|b)(a|b)"))))).usable);
+
+    // OK Serve mode (second request for a regex is answered from the cache)
+    checkBuildLimits("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)", 20);
+    {
+        // A counted repetition whose NFA alone is over max_bytes is rejected unbuilt.
+        DFABuildOptions small;
+        small.maxBytes = 1 << 20;
+        bool threw = false;
+        try
+        {
+            compilePattern("(a{1000}){1000}", small);
+        }
+        catch (const DFABuildError &e)
+        {
+            threw = e.limit == DFABuildError::MaxBytes && e.states == 0;
+        }
+        assert(threw);
+        nlohmann::json huge = handleServeRequest({{"op", "simulate"}, {"regex", "(a{1000}){1000}"}, {"input", "a"}, {"max_bytes", 1 << 20}});
+        assert(huge["status"] == "error" && huge["limit"] == "max_bytes");
+    }
+    checkClosureLimits();
+    checkServeRequest("(a|b)*abb", "aabb", false);
+    checkServeRequest("(a|b)*abb", "aabb", true);
+    checkServeRequest("(a|b)*abb", "aab", false);
+    assert(handleServeRequest({{"op", "bogus"}})["status"] == "error");
+    {
+        nlohmann::json bad = handleServeRequest({{"op", "simulate"}, {"regex", "a(b"}, {"input", "ab"}});
+        assert(bad["status"] == "error" && bad["position"] == 1);
+    }
+
     std::cout << "\n===== [OK] Testing Minimized DFA State Counts =====\n";
     checkMinimizedStateCount("(a|b)*abb", 5); // Depends on construction
     checkMinimizedStateCount("a*", 2);
     checkMinimizedStateCount("a|b", 2);
+    checkMinimizedEquivalent("(a|b)*abb", "abc", 4, 7);
+    checkMinimizedEquivalent("(a|b)*a(a|b)(a|b)", "ab", 8, 9);
+    checkMinimizedEquivalent("(ab|ba)*|c", "abc", 5, 8);
+    checkMinimizedEquivalent("a*b*a*", "ab", 3, 9);
+    checkMinimizedEquivalent("[ab]+c?|c+", "abc", 4, 7);
+    checkMinimizedEquivalent("(a|b)+|[ab][ab]*", "abc", 2, 7);
+    checkMinimizedEquivalent("(a|b)*a(a|b){2}", "ab", 8, 9);
 
     std::cout << "\n[OK] All assertions passed.\n";
     return 0;